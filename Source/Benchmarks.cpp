@@ -0,0 +1,746 @@
+/*
+  ==============================================================================
+
+    Benchmark suite.
+
+  ==============================================================================
+*/
+
+#include "Benchmarks.h"
+#include "PluginProcessor.h"
+
+#include "juce_igutil/AlignedArena.h"
+#include "juce_igutil/AudioFileStream.h"
+#include "juce_igutil/BlockCapture.h"
+#include "juce_igutil/BlockReplayer.h"
+#include "juce_igutil/MemoryAccounting.h"
+#include "juce_igutil/Profiler.h"
+#include "juce_igutil/Stopwatch.h"
+#include "juce_igutil/TableCache.h"
+
+#include "audio_processing_float/Convolver.h"
+#include "audio_processing_float/FilterBank.h"
+#include "audio_processing_float/FixedBlockAdapter.h"
+#include "audio_processing_float/Oversampler.h"
+#include "audio_processing_float/SampleGuard.h"
+#include "audio_processing_float/SampleRateConverter.h"
+#include "audio_processing_float/SamplerVoice.h"
+#include "audio_processing_float/SineWaveSynthesiser.h"
+#include "audio_processing_double/Convolver.h"
+#include "audio_processing_double/FilterBank.h"
+#include "audio_processing_double/FixedBlockAdapter.h"
+#include "audio_processing_double/Oversampler.h"
+#include "audio_processing_double/SampleGuard.h"
+#include "audio_processing_double/SampleRateConverter.h"
+#include "audio_processing_double/SamplerVoice.h"
+#include "audio_processing_double/SineWaveSynthesiser.h"
+
+#include <limits>
+
+using namespace juce;
+using namespace juce_igutil;
+
+namespace {
+
+const int benchmarkBlockSize = 512;
+const int benchmarkNumChannels = 2;
+const int benchmarkIterations = 10000;
+const double benchmarkSampleRate = 48000.0;
+const int benchmarkInternalBlockSize = 64;
+const int benchmarkNumFilters = 16;
+const int benchmarkConvolverIterations = 1000;
+const int benchmarkConvolverHeadPartitions = 8;
+const int benchmarkTableCacheInstances = 16;
+const int benchmarkStartupInstances = 32;
+const int benchmarkCaptureIterations = 1000;
+const int benchmarkSamplerVoices = 16;
+const int benchmarkSamplerHeadLength = 8192;
+const double benchmarkSamplerSeconds = 4.0;
+const double benchmarkFileStreamSeconds = 3.0;
+const int benchmarkFileStreamChunkSize = 4096;
+
+// Fill with low-level noise, optionally sprinkled with denormals.
+template <typename SampleType>
+void fillTestBuffer (AudioBuffer<SampleType>& buffer, const bool withDenormals)
+{
+    Random random (1234);
+    for (int chan = 0; chan < buffer.getNumChannels(); ++chan)
+        for (int i = 0; i < buffer.getNumSamples(); ++i)
+            buffer.setSample (chan, i, static_cast<SampleType> (random.nextFloat() * 0.2f - 0.1f));
+
+    if (withDenormals)
+        for (int chan = 0; chan < buffer.getNumChannels(); ++chan)
+            for (int i = 0; i < buffer.getNumSamples(); i += 64)
+                buffer.setSample (chan, i, std::numeric_limits<SampleType>::denorm_min() * 100);
+}
+
+// Noise decaying by 60 dB over the given length, like a reverb tail.
+template <typename SampleType>
+void fillImpulseResponse (AudioBuffer<SampleType>& ir, const double seconds)
+{
+    const int numSamples = (int) (seconds * benchmarkSampleRate);
+    ir.setSize (1, numSamples);
+    Random random (5678);
+    for (int i = 0; i < numSamples; ++i)
+        ir.setSample (0, i, static_cast<SampleType> ((random.nextFloat() * 2.0f - 1.0f) * std::pow (10.0, -3.0 * i / numSamples)));
+}
+
+// Spread band-pass filters a third of an octave apart from 100 Hz, alternating between channels.
+template <typename FilterBankType>
+void setUpFilterBank (FilterBankType& filterBank)
+{
+    for (int i = 0; i < filterBank.getMaxFilters(); ++i)
+        filterBank.setFilter (i, i % benchmarkNumChannels, FilterBankType::typeBandPass, 100.0 * std::pow (2.0, i / 3.0), 4.0);
+}
+
+// tanh saturation:  the simplest stage that needs oversampling.
+template <typename NodeBase, typename SampleType>
+class SaturatorNode : public NodeBase
+{
+public:
+    void prepare (const double, const int, const int, AlignedArena&) override {}
+
+    void process (AudioBuffer<SampleType>& buffer, int startSample, int numSamples) override
+    {
+        for (int chan = 0; chan < buffer.getNumChannels(); ++chan)
+        {
+            SampleType* pData = buffer.getWritePointer (chan, startSample);
+            for (int i = 0; i < numSamples; ++i)
+                pData[i] = std::tanh (pData[i] * static_cast<SampleType> (4));
+        }
+    }
+};
+
+// Process a whole buffer in slices of 1, 2, ... 7 samples, like a badly behaved host.
+template <typename NodeType, typename SampleType>
+void processInSlices (NodeType& node, AudioBuffer<SampleType>& buffer)
+{
+    int sliceSize = 1;
+    for (int start = 0; start < buffer.getNumSamples(); start += sliceSize)
+    {
+        sliceSize = jmin (sliceSize % 7 + 1, buffer.getNumSamples() - start);
+        node.process (buffer, start, sliceSize);
+    }
+}
+
+}
+
+//==============================================================================
+Benchmarks::Benchmarks (std::shared_ptr<MTLogger> _pMTL)
+    : pMTL (_pMTL)
+{
+}
+
+void Benchmarks::runAll()
+{
+    pMTL->info ("BENCHMARKS:  starting.");
+    runSampleGuard();
+    runFixedBlockSize();
+    runFilterBank();
+    runConvolver();
+    runOversampler();
+    runSampleRateConverter();
+    runTableCache();
+    runInstanceStartup();
+    runBlockCapture();
+    runSamplerVoice();
+    runMemoryAccounting();
+    runAudioFileStream();
+    pMTL->info ("BENCHMARKS:  done.");
+}
+
+void Benchmarks::profile (const String& label, const int numIterations, const std::function<void()>& function)
+{
+    // Stats are logged here, once, rather than by the profiler itself.
+    const int numWarmups = numIterations / 10;
+    Profiler profiler (label.toStdString(), pMTL, numWarmups, std::numeric_limits<unsigned long long>::max());
+
+    for (int i = 0; i < numWarmups + numIterations; ++i)
+    {
+        profiler.start();
+        function();
+        profiler.stop();
+    }
+
+    pMTL->info (label + String (":  ") + profiler.toString());
+}
+
+//==============================================================================
+void Benchmarks::runSampleGuard()
+{
+    AudioBuffer<float> floatBuffer (benchmarkNumChannels, benchmarkBlockSize);
+    AudioBuffer<double> doubleBuffer (benchmarkNumChannels, benchmarkBlockSize);
+    audio_processing_float::SampleGuard floatGuard (pMTL, std::numeric_limits<int>::max());
+    audio_processing_double::SampleGuard doubleGuard (pMTL, std::numeric_limits<int>::max());
+
+    const String blockText = String (" (") + String (benchmarkNumChannels) + String ("x") + String (benchmarkBlockSize) + String (")");
+
+    // clean signal:  the cost of leaving the scan on in production
+    fillTestBuffer (floatBuffer, false);
+    fillTestBuffer (doubleBuffer, false);
+    profile ("SampleGuard scan, float, clean" + blockText, benchmarkIterations, [&]() {
+        floatGuard.check (floatBuffer, 0, benchmarkBlockSize, 0);
+    });
+    profile ("SampleGuard scan, double, clean" + blockText, benchmarkIterations, [&]() {
+        doubleGuard.check (doubleBuffer, 0, benchmarkBlockSize, 0);
+    });
+
+    // denormals present, counted but left alone
+    fillTestBuffer (floatBuffer, true);
+    fillTestBuffer (doubleBuffer, true);
+    profile ("SampleGuard scan, float, denormals" + blockText, benchmarkIterations, [&]() {
+        floatGuard.check (floatBuffer, 0, benchmarkBlockSize, 0);
+    });
+    profile ("SampleGuard scan, double, denormals" + blockText, benchmarkIterations, [&]() {
+        doubleGuard.check (doubleBuffer, 0, benchmarkBlockSize, 0);
+    });
+
+    // denormals present and flushed (refilled each time so there is always something to flush)
+    floatGuard.setSanitising (true);
+    doubleGuard.setSanitising (true);
+    profile ("SampleGuard scan + sanitise, float, denormals" + blockText, benchmarkIterations, [&]() {
+        for (int chan = 0; chan < benchmarkNumChannels; ++chan)
+            floatBuffer.setSample (chan, 0, std::numeric_limits<float>::denorm_min());
+        floatGuard.check (floatBuffer, 0, benchmarkBlockSize, 0);
+    });
+    profile ("SampleGuard scan + sanitise, double, denormals" + blockText, benchmarkIterations, [&]() {
+        for (int chan = 0; chan < benchmarkNumChannels; ++chan)
+            doubleBuffer.setSample (chan, 0, std::numeric_limits<double>::denorm_min());
+        doubleGuard.check (doubleBuffer, 0, benchmarkBlockSize, 0);
+    });
+}
+
+//==============================================================================
+void Benchmarks::runFixedBlockSize()
+{
+    // Every run renders the same number of samples, so the stats compare per-sample cost directly.
+    AudioBuffer<float> floatBuffer (benchmarkNumChannels, benchmarkBlockSize);
+    AudioBuffer<double> doubleBuffer (benchmarkNumChannels, benchmarkBlockSize);
+    floatBuffer.clear();
+    doubleBuffer.clear();
+
+    AlignedArena arena;
+    audio_processing_float::SineWaveSynthesiser floatSynth (pMTL);
+    audio_processing_double::SineWaveSynthesiser doubleSynth (pMTL);
+    audio_processing_float::FixedBlockAdapter floatAdapter (&floatSynth, benchmarkInternalBlockSize);
+    audio_processing_double::FixedBlockAdapter doubleAdapter (&doubleSynth, benchmarkInternalBlockSize);
+    floatAdapter.prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+    doubleAdapter.prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+
+    const String blockText = String (" (") + String (benchmarkNumChannels) + String ("x") + String (benchmarkBlockSize) + String (")");
+    const String adapterText = String (", fixed ") + String (benchmarkInternalBlockSize) + String ("-sample blocks");
+
+    // host-driven, whole blocks:  the best case
+    profile ("Render, float, host blocks" + blockText, benchmarkIterations, [&]() {
+        floatSynth.process (floatBuffer, 0, benchmarkBlockSize);
+    });
+    profile ("Render, double, host blocks" + blockText, benchmarkIterations, [&]() {
+        doubleSynth.process (doubleBuffer, 0, benchmarkBlockSize);
+    });
+
+    // host-driven, 1-7 sample slices:  the worst case
+    profile ("Render, float, 1-7 sample slices" + blockText, benchmarkIterations, [&]() {
+        processInSlices (floatSynth, floatBuffer);
+    });
+    profile ("Render, double, 1-7 sample slices" + blockText, benchmarkIterations, [&]() {
+        processInSlices (doubleSynth, doubleBuffer);
+    });
+
+    // the same slices through the adapter
+    profile ("Render, float, 1-7 sample slices" + adapterText + blockText, benchmarkIterations, [&]() {
+        processInSlices (floatAdapter, floatBuffer);
+    });
+    profile ("Render, double, 1-7 sample slices" + adapterText + blockText, benchmarkIterations, [&]() {
+        processInSlices (doubleAdapter, doubleBuffer);
+    });
+
+    // and whole blocks through the adapter, to show its own overhead
+    profile ("Render, float, host blocks" + adapterText + blockText, benchmarkIterations, [&]() {
+        floatAdapter.process (floatBuffer, 0, benchmarkBlockSize);
+    });
+    profile ("Render, double, host blocks" + adapterText + blockText, benchmarkIterations, [&]() {
+        doubleAdapter.process (doubleBuffer, 0, benchmarkBlockSize);
+    });
+}
+
+//==============================================================================
+void Benchmarks::runFilterBank()
+{
+    AudioBuffer<float> floatSource (benchmarkNumChannels, benchmarkBlockSize);
+    AudioBuffer<double> doubleSource (benchmarkNumChannels, benchmarkBlockSize);
+    AudioBuffer<float> floatBuffer (benchmarkNumChannels, benchmarkBlockSize);
+    AudioBuffer<double> doubleBuffer (benchmarkNumChannels, benchmarkBlockSize);
+    fillTestBuffer (floatSource, false);
+    fillTestBuffer (doubleSource, false);
+
+    AlignedArena arena;
+    audio_processing_float::FilterBank floatBiquads (audio_processing_float::FilterBank::topologyBiquad, benchmarkNumFilters);
+    audio_processing_float::FilterBank floatSVFs (audio_processing_float::FilterBank::topologySVF, benchmarkNumFilters);
+    audio_processing_double::FilterBank doubleBiquads (audio_processing_double::FilterBank::topologyBiquad, benchmarkNumFilters);
+    audio_processing_double::FilterBank doubleSVFs (audio_processing_double::FilterBank::topologySVF, benchmarkNumFilters);
+    setUpFilterBank (floatBiquads);
+    setUpFilterBank (floatSVFs);
+    setUpFilterBank (doubleBiquads);
+    setUpFilterBank (doubleSVFs);
+    floatBiquads.prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+    floatSVFs.prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+    doubleBiquads.prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+    doubleSVFs.prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+
+    const String blockText = String (" (") + String (benchmarkNumChannels) + String ("x") + String (benchmarkBlockSize) + String (")");
+    const String floatText = String (", ") + String (benchmarkNumFilters) + String (" filters, ")
+        + String (audio_processing_float::FilterBank::numLanes) + String (" per vector");
+    const String doubleText = String (", ") + String (benchmarkNumFilters) + String (" filters, ")
+        + String (audio_processing_double::FilterBank::numLanes) + String (" per vector");
+
+    // refilled every time (a plain copy), so the filters don't just decay into denormals
+    profile ("FilterBank, float, biquad" + floatText + blockText, benchmarkIterations, [&]() {
+        floatBuffer.makeCopyOf (floatSource, true);
+        floatBiquads.process (floatBuffer, 0, benchmarkBlockSize);
+    });
+    profile ("FilterBank, float, SVF" + floatText + blockText, benchmarkIterations, [&]() {
+        floatBuffer.makeCopyOf (floatSource, true);
+        floatSVFs.process (floatBuffer, 0, benchmarkBlockSize);
+    });
+    profile ("FilterBank, double, biquad" + doubleText + blockText, benchmarkIterations, [&]() {
+        doubleBuffer.makeCopyOf (doubleSource, true);
+        doubleBiquads.process (doubleBuffer, 0, benchmarkBlockSize);
+    });
+    profile ("FilterBank, double, SVF" + doubleText + blockText, benchmarkIterations, [&]() {
+        doubleBuffer.makeCopyOf (doubleSource, true);
+        doubleSVFs.process (doubleBuffer, 0, benchmarkBlockSize);
+    });
+}
+
+//==============================================================================
+void Benchmarks::runConvolver()
+{
+    const double irSeconds[] = { 0.1, 1.0, 10.0 };
+    const int blockSizes[] = { 64, 256, 1024 };
+    const int maxBlockSize = 1024;
+
+    AudioBuffer<float> floatSource (benchmarkNumChannels, maxBlockSize);
+    AudioBuffer<double> doubleSource (benchmarkNumChannels, maxBlockSize);
+    AudioBuffer<float> floatBuffer (benchmarkNumChannels, maxBlockSize);
+    AudioBuffer<double> doubleBuffer (benchmarkNumChannels, maxBlockSize);
+    fillTestBuffer (floatSource, false);
+    fillTestBuffer (doubleSource, false);
+
+    // One host block per call, fresh input each time.  The arena is declared
+    // first so it outlives the convolver and its worker thread.
+    auto benchmark = [this] (auto& convolver, auto& buffer, const auto& source, const int blockSize, const String& label)
+    {
+        AlignedArena arena;
+        convolver.prepare (benchmarkSampleRate, blockSize, benchmarkNumChannels, arena);
+        profile (label, benchmarkConvolverIterations, [&]() {
+            for (int chan = 0; chan < benchmarkNumChannels; ++chan)
+                buffer.copyFrom (chan, 0, source, chan, 0, blockSize);
+            convolver.process (buffer, 0, blockSize);
+        });
+        convolver.releaseResources();
+    };
+
+    for (const double seconds : irSeconds)
+    {
+        AudioBuffer<float> floatIR;
+        AudioBuffer<double> doubleIR;
+        fillImpulseResponse (floatIR, seconds);
+        fillImpulseResponse (doubleIR, seconds);
+
+        for (const int blockSize : blockSizes)
+        {
+            const String text = String (", IR ") + String (seconds, 1) + String (" s, ") + String (blockSize) + String ("-sample blocks");
+            const String workerText = String (", tail after ") + String (benchmarkConvolverHeadPartitions) + String (" partitions on worker thread");
+
+            {
+                audio_processing_float::Convolver convolver (pMTL);
+                convolver.loadImpulseResponse (floatIR);
+                benchmark (convolver, floatBuffer, floatSource, blockSize, "Convolver, float" + text);
+            }
+            {
+                audio_processing_double::Convolver convolver (pMTL);
+                convolver.loadImpulseResponse (doubleIR);
+                benchmark (convolver, doubleBuffer, doubleSource, blockSize, "Convolver, double" + text);
+            }
+
+            // offloading only makes a difference once there are more partitions than the head
+            if (seconds * benchmarkSampleRate > benchmarkConvolverHeadPartitions * blockSize)
+            {
+                {
+                    audio_processing_float::Convolver convolver (pMTL, 0, benchmarkConvolverHeadPartitions);
+                    convolver.loadImpulseResponse (floatIR);
+                    benchmark (convolver, floatBuffer, floatSource, blockSize, "Convolver, float" + text + workerText);
+                }
+                {
+                    audio_processing_double::Convolver convolver (pMTL, 0, benchmarkConvolverHeadPartitions);
+                    convolver.loadImpulseResponse (doubleIR);
+                    benchmark (convolver, doubleBuffer, doubleSource, blockSize, "Convolver, double" + text + workerText);
+                }
+            }
+        }
+    }
+}
+
+//==============================================================================
+void Benchmarks::runOversampler()
+{
+    AudioBuffer<float> floatSource (benchmarkNumChannels, benchmarkBlockSize);
+    AudioBuffer<double> doubleSource (benchmarkNumChannels, benchmarkBlockSize);
+    AudioBuffer<float> floatBuffer (benchmarkNumChannels, benchmarkBlockSize);
+    AudioBuffer<double> doubleBuffer (benchmarkNumChannels, benchmarkBlockSize);
+    fillTestBuffer (floatSource, false);
+    fillTestBuffer (doubleSource, false);
+
+    AlignedArena arena;
+    SaturatorNode<audio_processing_float::ProcessorNode, float> floatSaturator;
+    SaturatorNode<audio_processing_double::ProcessorNode, double> doubleSaturator;
+
+    const String blockText = String (" (") + String (benchmarkNumChannels) + String ("x") + String (benchmarkBlockSize) + String (")");
+
+    // 1x is the saturator on its own
+    for (int numStages = 0; numStages <= audio_processing_float::Oversampler::maxNumStages; ++numStages)
+    {
+        const String text = String (", tanh, ") + String (1 << numStages) + String ("x") + blockText;
+
+        if (numStages == 0)
+        {
+            profile ("Oversampler, float" + text, benchmarkIterations, [&]() {
+                floatBuffer.makeCopyOf (floatSource, true);
+                floatSaturator.process (floatBuffer, 0, benchmarkBlockSize);
+            });
+            profile ("Oversampler, double" + text, benchmarkIterations, [&]() {
+                doubleBuffer.makeCopyOf (doubleSource, true);
+                doubleSaturator.process (doubleBuffer, 0, benchmarkBlockSize);
+            });
+            continue;
+        }
+
+        audio_processing_float::Oversampler floatOversampler (&floatSaturator, numStages);
+        audio_processing_double::Oversampler doubleOversampler (&doubleSaturator, numStages);
+        floatOversampler.prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+        doubleOversampler.prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+
+        profile ("Oversampler, float" + text, benchmarkIterations, [&]() {
+            floatBuffer.makeCopyOf (floatSource, true);
+            floatOversampler.process (floatBuffer, 0, benchmarkBlockSize);
+        });
+        profile ("Oversampler, double" + text, benchmarkIterations, [&]() {
+            doubleBuffer.makeCopyOf (doubleSource, true);
+            doubleOversampler.process (doubleBuffer, 0, benchmarkBlockSize);
+        });
+    }
+}
+
+//==============================================================================
+void Benchmarks::runSampleRateConverter()
+{
+    AudioBuffer<float> floatSource (benchmarkNumChannels, benchmarkBlockSize);
+    AudioBuffer<double> doubleSource (benchmarkNumChannels, benchmarkBlockSize);
+    fillTestBuffer (floatSource, false);
+    fillTestBuffer (doubleSource, false);
+
+    const char* qualityNames[] = { "draft", "normal", "high", "best" };
+    const double inputRates[] = { 44100.0, 96000.0 };
+    const double outputRate = 48000.0;
+
+    for (const double inputRate : inputRates)
+    {
+        for (int quality = audio_processing_float::SampleRateConverter::qualityDraft;
+             quality <= audio_processing_float::SampleRateConverter::qualityBest; ++quality)
+        {
+            AlignedArena arena;
+            audio_processing_float::SampleRateConverter floatConverter ((audio_processing_float::SampleRateConverter::Quality) quality);
+            audio_processing_double::SampleRateConverter doubleConverter ((audio_processing_double::SampleRateConverter::Quality) quality);
+            floatConverter.prepare (inputRate, outputRate, benchmarkNumChannels, benchmarkBlockSize, arena);
+            doubleConverter.prepare (inputRate, outputRate, benchmarkNumChannels, benchmarkBlockSize, arena);
+
+            const int maxOutputSamples = floatConverter.getMaxOutputSamples (benchmarkBlockSize);
+            AudioBuffer<float> floatOutput (benchmarkNumChannels, maxOutputSamples);
+            AudioBuffer<double> doubleOutput (benchmarkNumChannels, maxOutputSamples);
+
+            const String text = String (", ") + String (qualityNames[quality]) + String (" (") + String (floatConverter.getNumTaps()) +
+                String (" taps), ") + String (inputRate / 1000.0) + String ("k -> ") + String (outputRate / 1000.0) + String ("k (") +
+                String (benchmarkNumChannels) + String ("x") + String (benchmarkBlockSize) + String (")");
+
+            profile ("SampleRateConverter, float" + text, benchmarkIterations, [&]() {
+                floatConverter.process (floatSource, 0, benchmarkBlockSize, floatOutput, 0);
+            });
+            profile ("SampleRateConverter, double" + text, benchmarkIterations, [&]() {
+                doubleConverter.process (doubleSource, 0, benchmarkBlockSize, doubleOutput, 0);
+            });
+        }
+    }
+}
+
+//==============================================================================
+void Benchmarks::runTableCache()
+{
+    TableCache& cache = TableCache::getInstance();
+    const int numBuildsBefore = cache.getNumBuilds();
+
+    AlignedArena arena;
+    std::vector<std::unique_ptr<audio_processing_double::SampleRateConverter>> converters;
+    Stopwatch stopwatch;
+    long long firstNanos = 0;
+    for (int i = 0; i < benchmarkTableCacheInstances; ++i)
+    {
+        converters.emplace_back (new audio_processing_double::SampleRateConverter (audio_processing_double::SampleRateConverter::qualityBest));
+        converters.back()->prepare (44100.0, benchmarkSampleRate, benchmarkNumChannels, benchmarkBlockSize, arena);
+        if (i == 0)
+            firstNanos = (long long) stopwatch.read().count();
+    }
+    const long long totalNanos = (long long) stopwatch.read().count();
+
+    pMTL->info (String ("TableCache, double, best, 44.1k -> 48k:  first prepare ") + String (firstNanos / 1000) +
+        String (" us, each of the other ") + String (benchmarkTableCacheInstances - 1) + String (" ") +
+        String ((totalNanos - firstNanos) / (benchmarkTableCacheInstances - 1) / 1000) + String (" us; ") +
+        String (cache.getNumBuilds() - numBuildsBefore) + String (" table(s) built, ") +
+        String ((juce::uint64) cache.getBytesHeld()) + String (" bytes held for all of them"));
+}
+
+//==============================================================================
+void Benchmarks::runInstanceStartup()
+{
+    for (const bool useDouble : { false, true })
+    {
+        std::vector<std::unique_ptr<DoublePrecisionPocAudioProcessor>> processors;
+        Stopwatch stopwatch;
+        for (int i = 0; i < benchmarkStartupInstances; ++i)
+            processors.emplace_back (new DoublePrecisionPocAudioProcessor());
+        const long long constructNanos = (long long) stopwatch.read().count();
+
+        stopwatch.start();
+        for (auto& pProcessor : processors)
+        {
+            pProcessor->setProcessingPrecision (useDouble ? AudioProcessor::doublePrecision : AudioProcessor::singlePrecision);
+            pProcessor->prepareToPlay (benchmarkSampleRate, benchmarkBlockSize);
+        }
+        const long long prepareNanos = (long long) stopwatch.read().count();
+
+        // The suite runs inside a live processor, so the shared logging is already up:  these are
+        // the costs after the first instance, which also pays the logging startup.
+        pMTL->info (String ("Instance startup, ") + String (useDouble ? "double" : "float") + String (", ") +
+            String (benchmarkStartupInstances) + String (" instances:  construct after the first ") + String (constructNanos / benchmarkStartupInstances / 1000) +
+            String (" us each, first prepareToPlay ") + String (prepareNanos / benchmarkStartupInstances / 1000) + String (" us each; the first instance also took ") +
+            String (DoublePrecisionPocAudioProcessor::getLoggingStartupNanos() / 1000) + String (" us to start the log file and logging thread"));
+
+        for (auto& pProcessor : processors)
+            pProcessor->releaseResources();
+    }
+}
+
+//==============================================================================
+void Benchmarks::runBlockCapture()
+{
+    const File captureFile = File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("benchmark-capture", ".bcap");
+
+    AudioBuffer<float> floatBuffer (benchmarkNumChannels, benchmarkBlockSize);
+    fillTestBuffer (floatBuffer, false);
+    MidiBuffer midiMessages;
+
+    // Enough slots that the writer thread keeps up at full speed; real blocks come much slower.
+    {
+        BlockCapture capture (pMTL, captureFile, benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, 4096);
+        profile ("BlockCapture, float (" + String (benchmarkNumChannels) + "x" + String (benchmarkBlockSize) + ")", benchmarkCaptureIterations, [&]() {
+            capture.beginBlock (floatBuffer, midiMessages);
+            capture.endBlock (0);
+        });
+    }
+
+    for (const bool useDouble : { false, true })
+    {
+        DoublePrecisionPocAudioProcessor processor;
+        BlockReplayer::Options options;
+        options.useDoublePrecision = useDouble;
+        options.numSlowestToReport = 3;
+        BlockReplayer (pMTL).replay (processor, captureFile, options);
+    }
+
+    captureFile.deleteFile();
+}
+
+//==============================================================================
+void Benchmarks::runSamplerVoice()
+{
+    // A sample to stream:  long enough that almost all of it comes from disk.
+    const File sampleFile = File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("benchmark-sample", ".wav");
+    const int sampleLength = (int) (benchmarkSamplerSeconds * benchmarkSampleRate);
+    AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    {
+        AudioFormat* pFormat = formatManager.findFormatForFileExtension (sampleFile.getFileExtension());
+        std::unique_ptr<FileOutputStream> pStream (sampleFile.createOutputStream());
+        if (pFormat == nullptr || pStream == nullptr || pStream->failedToOpen())
+        {
+            pMTL->error ("SamplerVoice:  could not write the test sample.");
+            return;
+        }
+
+        std::unique_ptr<AudioFormatWriter> pWriter (pFormat->createWriterFor (
+            pStream.get(), benchmarkSampleRate, (unsigned int) benchmarkNumChannels, 24, {}, 0));
+        if (pWriter == nullptr)
+            return;
+        pStream.release();
+
+        AudioBuffer<float> sample (benchmarkNumChannels, sampleLength);
+        fillTestBuffer (sample, false);
+        pWriter->writeFromAudioSampleBuffer (sample, 0, sampleLength);
+    }
+
+    // Blocks are paced at the real-time rate, so the streamer has the time it would have in a session.
+    const int numBlocks = sampleLength / benchmarkBlockSize;
+    const auto blockPeriod = std::chrono::microseconds ((long long) (1.0e6 * benchmarkBlockSize / benchmarkSampleRate));
+    auto benchmark = [&] (auto& voices, auto& buffer, const String& label)
+    {
+        Profiler profiler (label.toStdString(), pMTL, 0, std::numeric_limits<unsigned long long>::max());
+        auto nextBlock = std::chrono::steady_clock::now();
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            profiler.start();
+            buffer.clear();
+            for (auto& pVoice : voices)
+                pVoice->process (buffer, 0, benchmarkBlockSize);
+            profiler.stop();
+
+            nextBlock += blockPeriod;
+            std::this_thread::sleep_until (nextBlock);
+        }
+
+        juce::uint64 numUnderruns = 0;
+        for (auto& pVoice : voices)
+            numUnderruns += pVoice->getNumUnderruns();
+        pMTL->info (label + String (":  ") + profiler.toString() + String (", ") + String (numUnderruns) + String (" underrun(s)"));
+    };
+
+    {
+        audio_processing_float::SamplerSound sound (sampleFile, formatManager, benchmarkSamplerHeadLength);
+        auto pStreamer = std::make_shared<audio_processing_float::SampleStreamer> (pMTL);
+        AlignedArena arena;
+        std::vector<std::unique_ptr<audio_processing_float::SamplerVoice>> voices;
+        for (int i = 0; i < benchmarkSamplerVoices; ++i)
+        {
+            voices.emplace_back (new audio_processing_float::SamplerVoice (pStreamer));
+            voices.back()->prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+            voices.back()->startNote (&sound, 1.0f / benchmarkSamplerVoices);
+        }
+        AudioBuffer<float> buffer (benchmarkNumChannels, benchmarkBlockSize);
+        benchmark (voices, buffer, "SamplerVoice, float, " + String (benchmarkSamplerVoices) + " voices");
+    }
+
+    {
+        audio_processing_double::SamplerSound sound (sampleFile, formatManager, benchmarkSamplerHeadLength);
+        auto pStreamer = std::make_shared<audio_processing_double::SampleStreamer> (pMTL);
+        AlignedArena arena;
+        std::vector<std::unique_ptr<audio_processing_double::SamplerVoice>> voices;
+        for (int i = 0; i < benchmarkSamplerVoices; ++i)
+        {
+            voices.emplace_back (new audio_processing_double::SamplerVoice (pStreamer));
+            voices.back()->prepare (benchmarkSampleRate, benchmarkBlockSize, benchmarkNumChannels, arena);
+            voices.back()->startNote (&sound, 1.0 / benchmarkSamplerVoices);
+        }
+        AudioBuffer<double> buffer (benchmarkNumChannels, benchmarkBlockSize);
+        benchmark (voices, buffer, "SamplerVoice, double, " + String (benchmarkSamplerVoices) + " voices");
+    }
+
+    sampleFile.deleteFile();
+}
+
+//==============================================================================
+void Benchmarks::runMemoryAccounting()
+{
+    MidiBuffer midiMessages;
+    for (const bool useDouble : { false, true })
+    {
+        const String label = String ("Memory, ") + String (useDouble ? "double" : "float");
+        DoublePrecisionPocAudioProcessor processor;
+        processor.setProcessingPrecision (useDouble ? AudioProcessor::doublePrecision : AudioProcessor::singlePrecision);
+        processor.prepareToPlay (benchmarkSampleRate, benchmarkBlockSize);
+        pMTL->info (label + String (":  ") + processor.getMemoryReport().toString());
+
+        AudioBuffer<float> floatBuffer (benchmarkNumChannels, benchmarkBlockSize);
+        AudioBuffer<double> doubleBuffer (benchmarkNumChannels, benchmarkBlockSize);
+        for (int i = 0; i < benchmarkIterations; ++i)
+        {
+            // cleared every block, as a host would hand over fresh input
+            if (useDouble)
+            {
+                doubleBuffer.clear();
+                processor.processBlock (doubleBuffer, midiMessages);
+            }
+            else
+            {
+                floatBuffer.clear();
+                processor.processBlock (floatBuffer, midiMessages);
+            }
+        }
+
+        if (AllocationCounter::isEnabled())
+            pMTL->info (label + String (":  ") + String (processor.getProcessAllocations()) + String (" allocation(s) in ") +
+                String (benchmarkIterations) + String (" blocks"));
+
+        processor.releaseResources();
+    }
+
+    pMTL->info (String ("Allocations:  ") + AllocationCounter::toString());
+}
+
+//==============================================================================
+void Benchmarks::runAudioFileStream()
+{
+    const File file = File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("benchmark-stream", ".wav");
+    const int length = (int) (benchmarkFileStreamSeconds * benchmarkSampleRate);
+    AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    // 32-bit float, so what comes back should match exactly.
+    AudioBuffer<float> source (benchmarkNumChannels, length);
+    fillTestBuffer (source, false);
+
+    Stopwatch stopwatch;
+    {
+        AudioFileStreamWriter writer (file, formatManager, benchmarkSampleRate, benchmarkNumChannels, 32);
+        if ( ! writer.isOpen())
+        {
+            pMTL->error ("AudioFileStream:  could not write the test file.");
+            return;
+        }
+        writer.write (source, length);
+    }
+    const long long writeNanos = (long long) stopwatch.read().count();
+
+    stopwatch.start();
+    int numRead = 0;
+    int firstMismatch = -1;
+    {
+        AudioFileStreamReader reader (file, formatManager, benchmarkFileStreamChunkSize);
+        AudioBuffer<float> block (benchmarkNumChannels, benchmarkBlockSize);
+        for (;;)
+        {
+            const int numInBlock = reader.read (block, benchmarkBlockSize);
+            if (numInBlock <= 0)
+                break;
+
+            for (int chan = 0; chan < benchmarkNumChannels && firstMismatch < 0; ++chan)
+                for (int i = 0; i < numInBlock && numRead + i < length; ++i)
+                    if (block.getSample (chan, i) != source.getSample (chan, numRead + i))
+                    {
+                        firstMismatch = numRead + i;
+                        break;
+                    }
+            numRead += numInBlock;
+        }
+    }
+    const long long readNanos = (long long) stopwatch.read().count();
+    file.deleteFile();
+
+    if (numRead != length || firstMismatch >= 0)
+    {
+        pMTL->error (String ("AudioFileStream:  read back ") + String (numRead) + String (" of ") + String (length) +
+            String (" samples; first mismatch at ") + String (firstMismatch));
+        jassertfalse;
+        return;
+    }
+
+    pMTL->info (String ("AudioFileStream, ") + String (length) + String (" samples:  written in ") + String (writeNanos / 1000) +
+        String (" us, read back and matched in ") + String (readNanos / 1000) + String (" us"));
+}
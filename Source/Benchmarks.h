@@ -0,0 +1,80 @@
+/*
+  ==============================================================================
+
+    Benchmark suite.  Enable with RUN_BENCHMARKS in PluginProcessor.cpp; results
+    go to the log through the MTLogger, in the same format as the Profiler.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <functional>
+
+#include "juce_igutil/MTLogger.h"
+
+//==============================================================================
+/**
+*/
+class Benchmarks
+{
+public:
+    Benchmarks (std::shared_ptr<juce_igutil::MTLogger> _pMTL);
+    virtual ~Benchmarks() = default;
+
+    // Run every benchmark.  Takes a while; don't call from the audio or message thread.
+    void runAll();
+
+    // Cost of the denormal / NaN scan, with and without sanitising, in both precisions.
+    void runSampleGuard();
+
+    // Rendering in the irregular few-sample slices some hosts send, directly and through a
+    // FixedBlockAdapter, against whole host blocks, in both precisions.
+    void runFixedBlockSize();
+
+    // A bank of band-pass filters across the channels, biquad and SVF, in both precisions.
+    void runFilterBank();
+
+    // Partitioned convolution for 0.1 - 10 s impulse responses at 64 - 1024 sample blocks,
+    // all on the audio thread and with the tail on the worker thread, in both precisions.
+    void runConvolver();
+
+    // A tanh stage on its own and at 2x, 4x and 8x oversampling, in both precisions.
+    void runOversampler();
+
+    // Sample-rate conversion at each quality, 44.1k -> 48k and 96k -> 48k, in both precisions.
+    void runSampleRateConverter();
+
+    // Preparing many converters that share one kernel table:  the first builds it, the rest just wait for it.
+    void runTableCache();
+
+    // Constructing processors after the first and their first prepareToPlay(), in each precision,
+    // plus what the first instance took to start the shared logging.
+    void runInstanceStartup();
+
+    // What capturing a block costs the audio thread, and a replay of the capture in each precision.
+    void runBlockCapture();
+
+    // Sixteen voices streaming a sample from disk, paced at real time, in both precisions.
+    void runSamplerVoice();
+
+    // What an instance holds in each precision, and anything it allocates while processing.
+    void runMemoryAccounting();
+
+    // Streaming a file out in one write longer than the writer's FIFO and back in, checking every sample.
+    void runAudioFileStream();
+
+private:
+    /**
+     * Time a function and log the stats under the given label.
+     *
+     * @param label - printed before the stats
+     * @param numIterations - number of timed calls
+     * @param function - the code to time
+     */
+    void profile (const juce::String& label, const int numIterations, const std::function<void()>& function);
+
+    std::shared_ptr<juce_igutil::MTLogger> pMTL;
+};
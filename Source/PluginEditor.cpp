@@ -19,17 +19,37 @@ DoublePrecisionPocAudioProcessorEditor::DoublePrecisionPocAudioProcessorEditor (
     // editor's size to whatever you need it to be.
     setSize (400, 300);
 
-    // Let it run a bit and then get the precision to display.
-    Timer::callAfterDelay(500, [this]() {
-        precisionText = 
-            String("Current audio-processing precision is:  ") + 
-            audioProcessor.getPrecisionText();
-    });
+    // Poll for metrics published by the audio thread.  Nothing is shared with
+    // the audio thread but the lock-free exchange.
+    startTimerHz(metricsPollHz);
 }
 
 DoublePrecisionPocAudioProcessorEditor::~DoublePrecisionPocAudioProcessorEditor()
 { 
-    // empty
+    stopTimer();
+}
+
+void DoublePrecisionPocAudioProcessorEditor::timerCallback()
+{
+    juce_igutil::ProcessorMetrics metrics;
+    if ( !audioProcessor.getMetrics(metrics) ) return;
+
+    String precision;
+    switch (metrics.precision) {
+        case juce_igutil::ProcessorMetrics::precisionSingle:            precision = "single"; break;
+        case juce_igutil::ProcessorMetrics::precisionDouble:            precision = "double"; break;
+        case juce_igutil::ProcessorMetrics::precisionSingleToDouble:    precision = "single (processed in double)"; break;
+        case juce_igutil::ProcessorMetrics::precisionDoubleToSingle:    precision = "double (processed in single)"; break;
+        default: break;
+    }
+
+    metricsText = 
+        String("Current audio-processing precision is:  ") + precision + "\n" +
+        String("CPU load:  ") + String(metrics.cpuLoadPercent, 1) + "%  (peak " + String(metrics.peakCpuLoadPercent, 1) + "%)\n" +
+        String("p99 block time:  ") + String(metrics.p99BlockNanos / 1000.0, 1) + " us\n" +
+        String("Deadline misses:  ") + String(metrics.deadlineMisses) + "\n" +
+        String("Denormals:  ") + String(metrics.denormals) + ",  NaN/Inf:  " + String(metrics.nonFinite);
+    repaint();
 }
 
 //==============================================================================
@@ -40,7 +60,7 @@ void DoublePrecisionPocAudioProcessorEditor::paint (juce::Graphics& g)
 
     g.setColour (juce::Colours::white);
     g.setFont (15.0f);
-    g.drawFittedText(precisionText, getLocalBounds(), juce::Justification::centred, 1);
+    g.drawFittedText(metricsText, getLocalBounds(), juce::Justification::centred, 5);
 }
 
 void DoublePrecisionPocAudioProcessorEditor::resized()
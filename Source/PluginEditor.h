@@ -14,7 +14,8 @@
 //==============================================================================
 /**
 */
-class DoublePrecisionPocAudioProcessorEditor  : public juce::AudioProcessorEditor
+class DoublePrecisionPocAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                                private juce::Timer
 {
 public:
     DoublePrecisionPocAudioProcessorEditor (DoublePrecisionPocAudioProcessor&);
@@ -25,11 +26,17 @@ public:
     void resized() override;
 
 private:
+    // Polls the processor's metrics and repaints if they changed.
+    void timerCallback() override;
+
+    // How often to poll.  The audio thread publishes much more often than this.
+    static const int metricsPollHz = 10;
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     DoublePrecisionPocAudioProcessor& audioProcessor;
 
-    juce::String precisionText = "Current audio-processing precision is:  ";
+    juce::String metricsText = "Current audio-processing precision is:  ";
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DoublePrecisionPocAudioProcessorEditor)
 };
@@ -11,14 +11,18 @@
 
 #include <JuceHeader.h>
 
+#include "juce_igutil/BufferConversion.h"
+#include "juce_igutil/Stopwatch.h"
+#include "juce_igutil/TableCache.h"
+
+#include "Benchmarks.h"
+
+#include <mutex>
+
 using namespace juce;
 using namespace juce_igutil;
 using namespace std;
 
-juce::String emptyText("");
-juce::String singlePrecisionText("single");
-juce::String doublePrecisionText("double");
-
 // Uncomment one or both of these to get special behavior for profiling tests:
 
 // Copy to double buffer, process in double, copy back to single buffer:
@@ -27,6 +31,71 @@ juce::String doublePrecisionText("double");
 // Define this to disable rendering during above test, to measure effect of the buffer copying.
 //#define DISABLE_RENDER
 
+// Define this to run the benchmark suite (on a separate thread) when the processor is created.
+//#define RUN_BENCHMARKS
+
+// Define this to render at a fixed internal block size, decoupled from the host's block sizes
+// (adds that many samples of latency).  Same as calling setFixedInternalBlockSize().
+//#define FIXED_INTERNAL_BLOCK_SIZE 64
+
+// Define this to render at a fixed internal sample rate, converting from and to the host's rate
+// (adds some latency).  Same as calling setFixedInternalSampleRate().
+//#define FIXED_INTERNAL_SAMPLE_RATE 48000.0
+
+// Define this to capture every block to a new file in the temp directory, for replay with
+// a BlockReplayer.  Same as calling setCaptureFile().
+//#define CAPTURE_BLOCKS
+
+// Define this to let the CPU load pick the precision block by block, whichever processBlock()
+// the host calls.  Same as calling setAdaptivePrecision(true).
+//#define ADAPTIVE_PRECISION
+
+// Allocation counting (see MemoryAccounting.h) replaces the global operator new, so it can't be
+// turned on here:  add COUNT_ALLOCATIONS to the project's preprocessor definitions instead.
+
+namespace {
+
+// One log file and logging thread for every instance in the process:  the first
+// instance creates them, and they go away with the last one holding them.
+struct SharedLogging {
+    std::mutex mutex;
+    std::weak_ptr<FileLogger> pLogger;
+    std::weak_ptr<MTLogger> pMTL;
+    int numInstances = 0;
+    long long startupNanos = 0;     // opening the file and starting the thread, the last time it was done
+};
+
+SharedLogging& getSharedLogging()
+{
+    static SharedLogging shared;
+    return shared;
+}
+
+#ifdef RUN_BENCHMARKS
+// The benchmarks create processors of their own, so only the first instance runs them.
+std::atomic<bool> benchmarksStarted { false };
+#endif
+
+// Fade the outgoing render out under the incoming one, which is already in block, over
+// the first numToFade samples.  remaining is what's left of a crossfade of length samples.
+template <typename SampleType>
+void crossfadeInto(
+    AudioBuffer<SampleType>& block,
+    const AudioBuffer<SampleType>& outgoing,
+    const int numToFade,
+    const int remaining,
+    const int length)
+{
+    const SampleType startGain = (SampleType) 1 - (SampleType) remaining / (SampleType) length;
+    const SampleType endGain = (SampleType) 1 - (SampleType) (remaining - numToFade) / (SampleType) length;
+    for (int chan = 0; chan < jmin(block.getNumChannels(), outgoing.getNumChannels()); ++chan) {
+        block.applyGainRamp(chan, 0, numToFade, startGain, endGain);
+        block.addFromWithRamp(chan, 0, outgoing.getReadPointer(chan), numToFade, (SampleType) 1 - startGain, (SampleType) 1 - endGain);
+    }
+}
+
+}
+
 //==============================================================================
 DoublePrecisionPocAudioProcessor::DoublePrecisionPocAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -37,34 +106,81 @@ DoublePrecisionPocAudioProcessor::DoublePrecisionPocAudioProcessor()
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
-                       ),
-
-    pLogger(std::shared_ptr<juce::FileLogger>(
-        FileLogger::createDefaultAppLogger(
-            "juce-double-precision-poc", 
-            "juce-double-precision-poc.txt", 
-            "Processor started."))),
-    pMTL(std::make_shared<MTLogger>(pLogger)),
-    precisionText(emptyText)
+                       )
 #endif
 {
-    // set up logger and profiler
-    Logger::setCurrentLogger(pLogger.get());
+    AllocationCounter::ScopedPhase phase(AllocationCounter::phaseConstruct);
+
+    // set up the shared logger, creating it if this is the first instance
+    {
+        SharedLogging& shared = getSharedLogging();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        pLogger = shared.pLogger.lock();
+        pMTL = shared.pMTL.lock();
+        if ( !pMTL ) {
+            Stopwatch stopwatch;
+            pLogger.reset(FileLogger::createDefaultAppLogger(
+                "juce-double-precision-poc", 
+                "juce-double-precision-poc.txt", 
+                "Processor started."));
+            pMTL = std::make_shared<MTLogger>(pLogger);
+            shared.pLogger = pLogger;
+            shared.pMTL = pMTL;
+            shared.startupNanos = (long long) stopwatch.read().count();
+            pMTL->info(String("STARTUP:  log file and logging thread started in ") + String(shared.startupNanos / 1000) + String(" us"));
+        }
+        ++shared.numInstances;
+        Logger::setCurrentLogger(pLogger.get());
+    }
     pLogger->logMessage("Audio Processor CONSTRUCTOR.");
-    const int numWarmupCycles = 2000;
-    pProfiler.reset(new Profiler(
-        "DoublePrecisionPocAudioProcessor_Profiler", pMTL, numWarmupCycles, 500));
+    pLoadMeter.reset(new LoadMeter(pMTL));
+    pPrecisionSelector.reset(new PrecisionSelector(pMTL));
 
-    // create synths
-    pFloatSynth = make_unique<audio_processing_float::SineWaveSynthesiser>(pMTL);
-    pDoubleSynth = make_unique<audio_processing_double::SineWaveSynthesiser>(pMTL);
+    // The profiler, synths and guards wait for prepareToPlay(), when the precision is known.
+
+#ifdef FIXED_INTERNAL_BLOCK_SIZE
+    setFixedInternalBlockSize(FIXED_INTERNAL_BLOCK_SIZE);
+#endif
+#ifdef FIXED_INTERNAL_SAMPLE_RATE
+    setFixedInternalSampleRate(FIXED_INTERNAL_SAMPLE_RATE);
+#endif
+#ifdef ADAPTIVE_PRECISION
+    setAdaptivePrecision(true);
+#endif
+#ifdef CAPTURE_BLOCKS
+    setCaptureFile(File::getSpecialLocation(File::tempDirectory).getNonexistentChildFile("juce-double-precision-poc", ".bcap"));
+#endif
+
+#ifdef RUN_BENCHMARKS
+    if ( !benchmarksStarted.exchange(true) ) {
+        pBenchmarkThread.reset(new std::thread([this]() {
+            AllocationCounter::setThreadName("benchmarks");
+            Benchmarks(pMTL).runAll();
+        }));
+    }
+#endif
 
     pLogger->logMessage("Constructor done.");
 }
 
+// The first instance's extra cost, for the benchmarks.
+long long DoublePrecisionPocAudioProcessor::getLoggingStartupNanos()
+{
+    SharedLogging& shared = getSharedLogging();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    return shared.startupNanos;
+}
+
 DoublePrecisionPocAudioProcessor::~DoublePrecisionPocAudioProcessor()
 {
-    Logger::setCurrentLogger(nullptr);
+    if (pBenchmarkThread && pBenchmarkThread->joinable())
+        pBenchmarkThread->join();
+
+    // The logger itself goes when the last reference to it does.
+    SharedLogging& shared = getSharedLogging();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if (--shared.numInstances == 0)
+        Logger::setCurrentLogger(nullptr);
 }
 
 //==============================================================================
@@ -91,6 +207,11 @@ bool DoublePrecisionPocAudioProcessor::producesMidi() const
    #endif
 }
 
+bool DoublePrecisionPocAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
 bool DoublePrecisionPocAudioProcessor::isMidiEffect() const
 {
    #if JucePlugin_IsMidiEffect
@@ -132,28 +253,204 @@ void DoublePrecisionPocAudioProcessor::changeProgramName (int index, const juce:
 //==============================================================================
 void DoublePrecisionPocAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    pFloatSynth->prepare(sampleRate);
-    pDoubleSynth->prepare(sampleRate);
+    AllocationCounter::ScopedPhase phase(AllocationCounter::phasePrepare);
+    pLoadMeter->prepare(sampleRate);
+    processAllocations.store(0);
+    numAllocatingBlocks = 0;
+
+    // Adaptive precision hands state between the synths, which the adapters' buffered audio would break.
+    const bool useAdapters = fixedInternalBlockSize > 0 || (fixedInternalSampleRate > 0.0 && fixedInternalSampleRate != sampleRate);
+#ifdef PROFILING_SINGLE_TO_DOUBLE
+    adaptiveActive = false;
+#else
+    adaptiveActive = adaptivePrecision && !useAdapters;
+#endif
+    if (adaptivePrecision && !adaptiveActive)
+        pMTL->warning("PREPARE:  adaptive precision is not available with a fixed internal block size or sample rate; staying fixed.");
+
+    // Build only the precision the host will call, unless the load picks.  The single-to-double
+    // test renders in double from float.
+    const bool useDouble = isUsingDoublePrecision();
+#ifdef PROFILING_SINGLE_TO_DOUBLE
+    buildProcessingPaths( !useDouble, true);
+#else
+    buildProcessingPaths( !useDouble || adaptiveActive, useDouble || adaptiveActive);
+#endif
 
     const int numChannels = getTotalNumOutputChannels();
-    const int numSamples = samplesPerBlock * 2;
 
+    // processBlock() converts in pieces of this size if the host sends more, so no need to guess high.
+    const int numSamples = samplesPerBlock;
+
+    // Everything below comes out of the arena.  It's rewound, not freed, on each prepare.
+    // The adapters need an input and an output block each, in both precisions.
+    const size_t adapterBytes = 2 * numChannels * (sizeof(float*) + sizeof(double*) +
+        fixedInternalBlockSize * (sizeof(float) + sizeof(double)) + 2 * AlignedArena::alignment);
+    const size_t adaptiveBytes = adaptiveActive ? numChannels * (sizeof(float*) + numSamples * sizeof(float) + AlignedArena::alignment) : 0;
+    arena.reset();
+    arena.reserve(numChannels * (sizeof(double*) + numSamples * sizeof(double) + AlignedArena::alignment) + adapterBytes + adaptiveBytes);
+
+    // Render directly, or through the fixed sample rate and then the fixed block size adapters.
+    // Only for the precisions that were built.
+    pFloatNode = pFloatSynth.get();
+    pDoubleNode = pDoubleSynth.get();
+    pFloatRateAdapter.reset();
+    pDoubleRateAdapter.reset();
+    pFloatBlockAdapter.reset();
+    pDoubleBlockAdapter.reset();
+    if (fixedInternalSampleRate > 0.0 && fixedInternalSampleRate != sampleRate) {
+        if (pFloatNode) {
+            pFloatRateAdapter = make_unique<audio_processing_float::FixedRateAdapter>(pFloatNode, fixedInternalSampleRate);
+            pFloatNode = pFloatRateAdapter.get();
+        }
+        if (pDoubleNode) {
+            pDoubleRateAdapter = make_unique<audio_processing_double::FixedRateAdapter>(pDoubleNode, fixedInternalSampleRate);
+            pDoubleNode = pDoubleRateAdapter.get();
+        }
+    }
+    if (fixedInternalBlockSize > 0) {
+        if (pFloatNode) {
+            pFloatBlockAdapter = make_unique<audio_processing_float::FixedBlockAdapter>(pFloatNode, fixedInternalBlockSize);
+            pFloatNode = pFloatBlockAdapter.get();
+        }
+        if (pDoubleNode) {
+            pDoubleBlockAdapter = make_unique<audio_processing_double::FixedBlockAdapter>(pDoubleNode, fixedInternalBlockSize);
+            pDoubleNode = pDoubleBlockAdapter.get();
+        }
+    }
+    if (pFloatNode) pFloatNode->prepare(sampleRate, samplesPerBlock, numChannels, arena);
+    if (pDoubleNode) pDoubleNode->prepare(sampleRate, samplesPerBlock, numChannels, arena);
+
+    // Both precisions report the same latency.
+    setLatencySamples(pDoubleNode ? pDoubleNode->getLatencySamples() : pFloatNode->getLatencySamples());
+    pMTL->debug(String("PREPARE:  ") + String(useDouble ? "double" : "single") +
+        String(" precision, fixedInternalSampleRate = ") + String(fixedInternalSampleRate) +
+        String(", fixedInternalBlockSize = ") + String(fixedInternalBlockSize) +
+        String(", latency = ") + String(getLatencySamples()));
+
+    pMTL->debug(String("PREPARE:  carving double buffer from arena:  numSamples = ") + String(numSamples));
+    double** doubleChannels = nullptr;
+    arena.allocateChannels(doubleChannels, numChannels, numSamples);
     if ( !pDoubleBuffer ) {
-        pMTL->debug(String("PREPARE:  allocating double buffer, using twice the requested size to make sure we have enough:  numSamples = ") + String(numSamples));
-        pDoubleBuffer.reset(new AudioBuffer<double>(numChannels, numSamples));
+        pDoubleBuffer.reset(new AudioBuffer<double>());
     }
-    else {
-        pMTL->debug(String("PREPARE:  RESIZING double buffer, using twice the requested size to make sure we have enough:  numSamples = ") + String(numSamples));
-        pDoubleBuffer->setSize(numChannels, numSamples, true, false, true);
+    pDoubleBuffer->setDataToReferTo(doubleChannels, numChannels, numSamples);
+
+    // Adaptive precision starts in the host's precision.
+    pFloatBuffer.reset();
+    nodeState.clear();
+    if (adaptiveActive) {
+        float** floatChannels = nullptr;
+        arena.allocateChannels(floatChannels, numChannels, numSamples);
+        pFloatBuffer.reset(new AudioBuffer<float>());
+        pFloatBuffer->setDataToReferTo(floatChannels, numChannels, numSamples);
+        nodeState.resize((size_t) jmax(pFloatNode->getNumStateValues(), pDoubleNode->getNumStateValues()));
+        pPrecisionSelector->prepare(sampleRate, useDouble);
+        pMTL->debug(String("PREPARE:  adaptive precision, starting in ") + String(useDouble ? "double" : "single"));
+    }
+    renderingInDouble = useDouble;
+    crossfadeRemaining = 0;
+
+    // A new capture starts at each prepare, so replay starts from the same state.
+    pCapture.reset();
+    if (captureFile != File()) {
+        pCapture = make_unique<BlockCapture>(pMTL, captureFile, sampleRate, samplesPerBlock,
+            jmax(getTotalNumInputChannels(), getTotalNumOutputChannels()));
     }
+
+    // From here on, nothing may allocate from the arena until the next prepare.
+    arena.seal();
+    pMTL->debug(String("PREPARE:  arena bytesUsed = ") + String((juce::uint64)arena.getBytesUsed()) +
+        String(", bytesReserved = ") + String((juce::uint64)arena.getBytesReserved()));
+    pMTL->debug(String("PREPARE:  shared tables = ") + String(TableCache::getInstance().getNumTables()) +
+        String(", bytes = ") + String((juce::uint64)TableCache::getInstance().getBytesHeld()));
+    pMTL->info(String("MEMORY:  ") + getMemoryReport().toString());
+    if (AllocationCounter::isEnabled())
+        pMTL->info(String("ALLOCATIONS:  ") + AllocationCounter::toString());
+}
+
+juce_igutil::MemoryReport DoublePrecisionPocAudioProcessor::getMemoryReport()
+{
+    MemoryReport report;
+    report.add("arena", arena.getBytesReserved());
+    if (pDoubleBuffer)
+        report.add("double buffer", sizeof(double) * (size_t) (pDoubleBuffer->getNumChannels() * pDoubleBuffer->getNumSamples()), MemoryReport::kindIncluded);
+    if (pFloatBuffer)
+        report.add("float buffer", sizeof(float) * (size_t) (pFloatBuffer->getNumChannels() * pFloatBuffer->getNumSamples()), MemoryReport::kindIncluded);
+
+    // The synths' and adapters' own state; their scratch is in the arena.
+    if (pFloatSynth) report.add("float synth", sizeof(*pFloatSynth));
+    if (pDoubleSynth) report.add("double synth", sizeof(*pDoubleSynth));
+    if (pFloatGuard) report.add("float guard", sizeof(*pFloatGuard));
+    if (pDoubleGuard) report.add("double guard", sizeof(*pDoubleGuard));
+    if (pFloatRateAdapter) report.add("float rate adapter", sizeof(*pFloatRateAdapter));
+    if (pDoubleRateAdapter) report.add("double rate adapter", sizeof(*pDoubleRateAdapter));
+    if (pFloatBlockAdapter) report.add("float block adapter", sizeof(*pFloatBlockAdapter));
+    if (pDoubleBlockAdapter) report.add("double block adapter", sizeof(*pDoubleBlockAdapter));
+    if (pProfiler) report.add("profiler", sizeof(*pProfiler));
+    report.add("load meter", sizeof(*pLoadMeter));
+    report.add("node state", sizeof(double) * nodeState.capacity());
+    if (pCapture) report.add("capture ring", pCapture->getBytesHeld());
+
+    // Shared by every instance.  The queued messages' text isn't counted, just the queue entries.
+    const size_t queueDepth = pMTL->getQueueDepth();
+    report.add(String("logger queue (") + String((juce::uint64) queueDepth) + String(" messages)"), sizeof(String) * queueDepth, MemoryReport::kindShared);
+    report.add("shared tables", TableCache::getInstance().getBytesHeld(), MemoryReport::kindShared);
+    return report;
 }
 
 void DoublePrecisionPocAudioProcessor::releaseResources()
 {
+    AllocationCounter::ScopedPhase phase(AllocationCounter::phaseRelease);
+
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
-    pFloatSynth->releaseResources();
-    pDoubleSynth->releaseResources();
+    if (pFloatNode) pFloatNode->releaseResources();
+    if (pDoubleNode) pDoubleNode->releaseResources();
+}
+
+void DoublePrecisionPocAudioProcessor::buildProcessingPaths(const bool needFloat, const bool needDouble)
+{
+    if ( !pProfiler ) {
+        const int numWarmupCycles = 2000;
+        pProfiler.reset(new Profiler(
+            "DoublePrecisionPocAudioProcessor_Profiler", pMTL, numWarmupCycles, 500));
+    }
+
+    // Nodes may be adapters around the synths; prepareToPlay() rebuilds them.
+    pFloatNode = nullptr;
+    pDoubleNode = nullptr;
+
+    if (needFloat && !pFloatSynth) {
+        pFloatSynth = make_unique<audio_processing_float::SineWaveSynthesiser>(pMTL);
+        pFloatGuard = make_unique<audio_processing_float::SampleGuard>(pMTL);
+        pFloatGuard->setStageName(guardStageInput, "float input");
+        pFloatGuard->setStageName(guardStageOutput, "float output");
+        pFloatGuard->setEnabled(sampleGuardEnabled);
+        pFloatGuard->setSanitising(sampleGuardSanitising);
+    }
+    else if ( !needFloat ) {
+        pFloatBlockAdapter.reset();
+        pFloatRateAdapter.reset();
+        pFloatSynth.reset();
+        pFloatGuard.reset();
+    }
+
+    if (needDouble && !pDoubleSynth) {
+        pDoubleSynth = make_unique<audio_processing_double::SineWaveSynthesiser>(pMTL);
+        pDoubleGuard = make_unique<audio_processing_double::SampleGuard>(pMTL);
+        pDoubleGuard->setStageName(guardStageInput, "double input");
+        pDoubleGuard->setStageName(guardStageRender, "double render");
+        pDoubleGuard->setStageName(guardStageOutput, "double output");
+        pDoubleGuard->setEnabled(sampleGuardEnabled);
+        pDoubleGuard->setSanitising(sampleGuardSanitising);
+    }
+    else if ( !needDouble ) {
+        pDoubleBlockAdapter.reset();
+        pDoubleRateAdapter.reset();
+        pDoubleSynth.reset();
+        pDoubleGuard.reset();
+    }
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -189,7 +486,12 @@ void DoublePrecisionPocAudioProcessor::processBlock(
 {
     juce::ScopedNoDenormals noDenormals;
 
-    precisionText = singlePrecisionText;
+    // Not prepared for single precision.  Hosts shouldn't do this.
+    if ( !pFloatGuard ) {
+        jassertfalse;
+        buffer.clear();
+        return;
+    }
 
     static bool gotHere = false;
     if ( !gotHere ) {
@@ -199,28 +501,73 @@ void DoublePrecisionPocAudioProcessor::processBlock(
 
     // check for bypass
     if ( !getBypassParameter() ) {
-        //pProfiler->start();
+        // Anything the block allocates is counted (with COUNT_ALLOCATIONS) and logged.
+        AllocationCounter::ScopedPhase phase(AllocationCounter::phaseProcess);
+        AllocationCounter::setThreadName("audio");
+        const AllocationCounter::Counts allocationsBefore = AllocationCounter::getThreadCounts();
+
+        // copied before timing starts, so it doesn't count against the block
+        if (pCapture) pCapture->beginBlock(buffer, midiMessages);
+
+        pProfiler->start();
 
         const auto numChannel = getTotalNumOutputChannels();
 
+        pFloatGuard->check(buffer, 0, buffer.getNumSamples(), guardStageInput);
+
 #ifdef PROFILING_SINGLE_TO_DOUBLE
-        // copy to double buffer, process in double, copy back to single buffer
-        // Copy.  Note makeCopyOf does a setSize() already.  
-        pDoubleBuffer->makeCopyOf(buffer, true);
+        // copy to double buffer, process in double, copy back to single buffer.
+        // Not using makeCopyOf() here, because its setSize() would allocate
+        // (the double buffer refers to arena memory).  If the host ever sends
+        // more than we prepared for, do it in pieces.
+        const int maxSamples = pDoubleBuffer->getNumSamples();
+        for (int start = 0; start < buffer.getNumSamples(); start += maxSamples) {
+            const int numSamples = jmin(maxSamples, buffer.getNumSamples() - start);
+            AudioBuffer<float> floatBlock(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, numSamples);
+
+            // Copy.
+            convertBuffer(*pDoubleBuffer, floatBlock, numSamples);
+
+            // render - can be disabled to specifically test effect of copying:
+            #ifndef DISABLE_RENDER
+            pDoubleNode->process(*pDoubleBuffer, 0, numSamples);
+            #endif
+            pDoubleGuard->check(*pDoubleBuffer, 0, numSamples, guardStageRender);
+
+            // copy back to single buffer
+            convertBuffer(floatBlock, *pDoubleBuffer, numSamples);
+        }
+
+#else // normal
+        if (adaptiveActive)
+            renderAdaptive(buffer);
+        else
+            pFloatNode->process(buffer, 0, buffer.getNumSamples());
+#endif
 
-        // render - can be disabled to specifically test effect of copying:
-        #ifndef DISABLE_RENDER
-        pDoubleSynth->renderNextBlock(*pDoubleBuffer, 0, buffer.getNumSamples());
-        #endif
+        pFloatGuard->check(buffer, 0, buffer.getNumSamples(), guardStageOutput);
 
-        // copy back to single buffer
-        buffer.makeCopyOf(*pDoubleBuffer, true);
+        // From here on it's bookkeeping, and the profiler, guards, load meter and precision selector
+        // all log now and then, which allocates.  Those allocations are still made on the audio
+        // thread; they go in their own phase, so the report shows them apart from the rendering's.
+        const AllocationCounter::Counts allocationsAfter = AllocationCounter::getThreadCounts();
+        AllocationCounter::ScopedPhase logging(AllocationCounter::phaseProcessLogging);
 
-#else // normal
-        pFloatSynth->renderNextBlock(buffer, 0, buffer.getNumSamples());
+#ifdef PROFILING_SINGLE_TO_DOUBLE
+        pDoubleGuard->endBlock();
 #endif
+        pFloatGuard->endBlock();
 
-        //pProfiler->stop();
+        const long long nanos = pProfiler->stop();
+        if (pCapture) pCapture->endBlock(nanos);
+#ifdef PROFILING_SINGLE_TO_DOUBLE
+        updateMetrics(ProcessorMetrics::precisionSingleToDouble, nanos, buffer.getNumSamples());
+#else
+        updateMetrics(renderingInDouble ? ProcessorMetrics::precisionSingleToDouble : ProcessorMetrics::precisionSingle, nanos, buffer.getNumSamples());
+        if (adaptiveActive) pPrecisionSelector->update(pLoadMeter->getLoad(), buffer.getNumSamples());
+#endif
+
+        checkProcessAllocations(allocationsBefore, allocationsAfter);
     }
 }
 
@@ -231,7 +578,12 @@ void DoublePrecisionPocAudioProcessor::processBlock(
 {
     juce::ScopedNoDenormals noDenormals;
 
-    precisionText = doublePrecisionText;
+    // Not prepared for double precision.  Hosts shouldn't do this.
+    if ( !pDoubleGuard ) {
+        jassertfalse;
+        buffer.clear();
+        return;
+    }
 
     static bool gotHere = false;
     if ( !gotHere ) {
@@ -241,13 +593,189 @@ void DoublePrecisionPocAudioProcessor::processBlock(
 
     // check for bypass
     if ( !getBypassParameter() ) {
+        // Anything the block allocates is counted (with COUNT_ALLOCATIONS) and logged.
+        AllocationCounter::ScopedPhase phase(AllocationCounter::phaseProcess);
+        AllocationCounter::setThreadName("audio");
+        const AllocationCounter::Counts allocationsBefore = AllocationCounter::getThreadCounts();
+
+        // copied before timing starts, so it doesn't count against the block
+        if (pCapture) pCapture->beginBlock(buffer, midiMessages);
+
         pProfiler->start();
 
         const auto numChannels = getTotalNumOutputChannels();
 
-        pDoubleSynth->renderNextBlock(buffer, 0, buffer.getNumSamples());
+        pDoubleGuard->check(buffer, 0, buffer.getNumSamples(), guardStageInput);
+
+        if (adaptiveActive)
+            renderAdaptive(buffer);
+        else
+            pDoubleNode->process(buffer, 0, buffer.getNumSamples());
+
+        pDoubleGuard->check(buffer, 0, buffer.getNumSamples(), guardStageOutput);
+
+        // As above:  the bookkeeping logs, and its allocations are counted apart.
+        const AllocationCounter::Counts allocationsAfter = AllocationCounter::getThreadCounts();
+        AllocationCounter::ScopedPhase logging(AllocationCounter::phaseProcessLogging);
+
+        pDoubleGuard->endBlock();
+
+        const long long nanos = pProfiler->stop();
+        if (pCapture) pCapture->endBlock(nanos);
+        updateMetrics(renderingInDouble ? ProcessorMetrics::precisionDouble : ProcessorMetrics::precisionDoubleToSingle, nanos, buffer.getNumSamples());
+        if (adaptiveActive) pPrecisionSelector->update(pLoadMeter->getLoad(), buffer.getNumSamples());
+
+        checkProcessAllocations(allocationsBefore, allocationsAfter);
+    }
+}
+
+// Adaptive render of a float host block.  A switch happens at the block boundary:  the new
+// path picks up the old one's state, and both render until the crossfade is done.
+void DoublePrecisionPocAudioProcessor::renderAdaptive(juce::AudioBuffer<float>& buffer)
+{
+    const bool wantDouble = pPrecisionSelector->isDouble();
+    if (wantDouble != renderingInDouble) {
+        transferNodeState(wantDouble);
+        renderingInDouble = wantDouble;
+        crossfadeRemaining = precisionCrossfadeSamples;
+    }
+
+    // In pieces if the host sends more than we prepared for.
+    const int maxSamples = pFloatBuffer->getNumSamples();
+    for (int start = 0; start < buffer.getNumSamples(); start += maxSamples) {
+        const int numSamples = jmin(maxSamples, buffer.getNumSamples() - start);
+        AudioBuffer<float> block(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, numSamples);
+        if (crossfadeRemaining <= 0) {
+            renderInPrecision(block, renderingInDouble);
+            continue;
+        }
+
+        // The outgoing path renders a copy of the input, then fades out.
+        const int numChannels = jmin(block.getNumChannels(), pFloatBuffer->getNumChannels());
+        AudioBuffer<float> outgoing(pFloatBuffer->getArrayOfWritePointers(), numChannels, numSamples);
+        for (int chan = 0; chan < numChannels; ++chan)
+            outgoing.copyFrom(chan, 0, block, chan, 0, numSamples);
+        renderInPrecision(outgoing, !renderingInDouble);
+        renderInPrecision(block, renderingInDouble);
+
+        const int numToFade = jmin(numSamples, crossfadeRemaining);
+        crossfadeInto(block, outgoing, numToFade, crossfadeRemaining, precisionCrossfadeSamples);
+        crossfadeRemaining -= numToFade;
+    }
+}
+
+// Adaptive render of a double host block.  Same as above, with the buffers' roles swapped.
+void DoublePrecisionPocAudioProcessor::renderAdaptive(juce::AudioBuffer<double>& buffer)
+{
+    const bool wantDouble = pPrecisionSelector->isDouble();
+    if (wantDouble != renderingInDouble) {
+        transferNodeState(wantDouble);
+        renderingInDouble = wantDouble;
+        crossfadeRemaining = precisionCrossfadeSamples;
+    }
+
+    const int maxSamples = pDoubleBuffer->getNumSamples();
+    for (int start = 0; start < buffer.getNumSamples(); start += maxSamples) {
+        const int numSamples = jmin(maxSamples, buffer.getNumSamples() - start);
+        AudioBuffer<double> block(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, numSamples);
+        if (crossfadeRemaining <= 0) {
+            renderInPrecision(block, renderingInDouble);
+            continue;
+        }
+
+        const int numChannels = jmin(block.getNumChannels(), pDoubleBuffer->getNumChannels());
+        AudioBuffer<double> outgoing(pDoubleBuffer->getArrayOfWritePointers(), numChannels, numSamples);
+        for (int chan = 0; chan < numChannels; ++chan)
+            outgoing.copyFrom(chan, 0, block, chan, 0, numSamples);
+        renderInPrecision(outgoing, !renderingInDouble);
+        renderInPrecision(block, renderingInDouble);
+
+        const int numToFade = jmin(numSamples, crossfadeRemaining);
+        crossfadeInto(block, outgoing, numToFade, crossfadeRemaining, precisionCrossfadeSamples);
+        crossfadeRemaining -= numToFade;
+    }
+}
+
+// Float block:  render directly, or through the double buffer.
+void DoublePrecisionPocAudioProcessor::renderInPrecision(juce::AudioBuffer<float>& block, const bool inDouble)
+{
+    const int numSamples = block.getNumSamples();
+    if ( !inDouble ) {
+        pFloatNode->process(block, 0, numSamples);
+        return;
+    }
+
+    AudioBuffer<double> doubleBlock(pDoubleBuffer->getArrayOfWritePointers(), pDoubleBuffer->getNumChannels(), numSamples);
+    convertBuffer(doubleBlock, block, numSamples);
+    pDoubleNode->process(doubleBlock, 0, numSamples);
+    convertBuffer(block, doubleBlock, numSamples);
+}
+
+// Double block:  render directly, or through the float buffer.
+void DoublePrecisionPocAudioProcessor::renderInPrecision(juce::AudioBuffer<double>& block, const bool inDouble)
+{
+    const int numSamples = block.getNumSamples();
+    if (inDouble) {
+        pDoubleNode->process(block, 0, numSamples);
+        return;
+    }
+
+    AudioBuffer<float> floatBlock(pFloatBuffer->getArrayOfWritePointers(), pFloatBuffer->getNumChannels(), numSamples);
+    convertBuffer(floatBlock, block, numSamples);
+    pFloatNode->process(floatBlock, 0, numSamples);
+    convertBuffer(block, floatBlock, numSamples);
+}
+
+// State handover.  The node being left keeps rendering through the crossfade from the same state.
+void DoublePrecisionPocAudioProcessor::transferNodeState(const bool toDouble)
+{
+    if (toDouble) {
+        pFloatNode->saveState(nodeState.data());
+        pDoubleNode->loadState(nodeState.data());
+    }
+    else {
+        pDoubleNode->saveState(nodeState.data());
+        pFloatNode->loadState(nodeState.data());
+    }
+}
+
+// Metrics.  Called at the end of every processed block, on the audio thread.
+void DoublePrecisionPocAudioProcessor::updateMetrics(
+    const ProcessorMetrics::Precision precision, 
+    const long long blockNanos, 
+    const int numSamples)
+{
+    pLoadMeter->addBlock(blockNanos, numSamples);
+
+    if (++blocksSincePublish >= metricsPublishInterval) {
+        blocksSincePublish = 0;
+        metrics.precision = precision;
+        metrics.cpuLoadPercent = 100.0 * pLoadMeter->getLoad();
+        metrics.peakCpuLoadPercent = 100.0 * pLoadMeter->getPeakLoad();
+        metrics.deadlineMisses = pLoadMeter->getDeadlineMisses();
+        metrics.p99BlockNanos = pProfiler->getPercentileNanos(0.99);
+        metrics.denormals = (pFloatGuard ? pFloatGuard->getTotalDenormals() : 0) + (pDoubleGuard ? pDoubleGuard->getTotalDenormals() : 0);
+        metrics.nonFinite = (pFloatGuard ? pFloatGuard->getTotalNonFinite() : 0) + (pDoubleGuard ? pDoubleGuard->getTotalNonFinite() : 0);
+        metricsExchange.publish(metrics);
+    }
+}
+
+// Allocation check.  Called at the end of every processed block, on the audio thread, with counts
+// taken before the block's logging.  The warning itself allocates (as any MTLogger message does).
+void DoublePrecisionPocAudioProcessor::checkProcessAllocations(
+    const AllocationCounter::Counts& before,
+    const AllocationCounter::Counts& after)
+{
+    const juce::uint64 numAllocations = after.allocations - before.allocations;
+    if (numAllocations == 0) return;
+
+    processAllocations.fetch_add(numAllocations, std::memory_order_relaxed);
 
-        pProfiler->stop();
+    // The first allocating block, then every time the count of them doubles.
+    if (isPowerOfTwo(++numAllocatingBlocks)) {
+        pMTL->warning(String("PROCESS:  processBlock() allocated ") + String(numAllocations) + String(" time(s), ") +
+            String(after.bytes - before.bytes) + String(" bytes, in one block; ") + String(numAllocatingBlocks) +
+            String(" allocating block(s) since prepare"));
     }
 }
 
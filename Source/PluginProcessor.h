@@ -10,12 +10,27 @@
 
 #include <JuceHeader.h>
 
+#include "juce_igutil/AlignedArena.h"
+#include "juce_igutil/BlockCapture.h"
+#include "juce_igutil/LoadMeter.h"
+#include "juce_igutil/MemoryAccounting.h"
+#include "juce_igutil/MetricsExchange.h"
 #include "juce_igutil/MTLogger.h"
+#include "juce_igutil/PrecisionSelector.h"
 #include "juce_igutil/Profiler.h"
 
+#include "audio_processing_float/FixedBlockAdapter.h"
+#include "audio_processing_float/FixedRateAdapter.h"
+#include "audio_processing_float/SampleGuard.h"
 #include "audio_processing_float/SineWaveSynthesiser.h"
+#include "audio_processing_double/FixedBlockAdapter.h"
+#include "audio_processing_double/FixedRateAdapter.h"
+#include "audio_processing_double/SampleGuard.h"
 #include "audio_processing_double/SineWaveSynthesiser.h"
 
+#include <thread>
+#include <vector>
+
 //==============================================================================
 /**
 */
@@ -36,6 +51,7 @@ public:
 
     void processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer&) override;
     void processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -60,28 +76,215 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
-    const juce::String & getPrecisionText() const 
-    { 
-        return precisionText; 
+    /**
+     * Copy out the latest metrics published by the audio thread.  Lock-free.
+     * Only one thread (the editor's) may call this.
+     *
+     * @return true if they changed since the last call.
+     */
+    bool getMetrics(juce_igutil::ProcessorMetrics& metrics)
+    {
+        return metricsExchange.read(metrics);
+    }
+
+    // DSP load (1.0 = 100% of the real-time budget).  Safe to call from any thread.
+    double getCpuLoad() const { return pLoadMeter->getLoad(); }
+    double getPeakCpuLoad() const { return pLoadMeter->getPeakLoad(); }
+
+    // Average load levels that get logged when crossed (1.0 = 100%).  Safe to call from any thread.
+    void setCpuLoadThresholds(const double warning, const double overload)
+    {
+        pLoadMeter->setThresholds(warning, overload);
+    }
+
+    // Turn the denormal / NaN scan on or off (it's on by default).  Set before playing.
+    void setSampleGuardEnabled(const bool shouldBeEnabled)
+    {
+        sampleGuardEnabled = shouldBeEnabled;
+        if (pFloatGuard) pFloatGuard->setEnabled(shouldBeEnabled);
+        if (pDoubleGuard) pDoubleGuard->setEnabled(shouldBeEnabled);
+    }
+
+    // Flush any denormals or NaN/Inf found to zero (off by default).  Set before playing.
+    void setSampleGuardSanitising(const bool shouldSanitise)
+    {
+        sampleGuardSanitising = shouldSanitise;
+        if (pFloatGuard) pFloatGuard->setSanitising(shouldSanitise);
+        if (pDoubleGuard) pDoubleGuard->setSanitising(shouldSanitise);
+    }
+
+    /**
+     * Render at a fixed internal block size (a power of two) regardless of
+     * the host's block sizes, at the cost of that many samples of latency.
+     * 0 turns it off, so rendering follows the host.  Takes effect at the
+     * next prepareToPlay().
+     */
+    void setFixedInternalBlockSize(const int numSamples)
+    {
+        jassert(numSamples == 0 || juce::isPowerOfTwo(numSamples));
+        fixedInternalBlockSize = numSamples;
+    }
+
+    /**
+     * Render at a fixed internal sample rate regardless of the host's rate,
+     * converting in and out, at the cost of some latency.  0 turns it off.
+     * Takes effect at the next prepareToPlay().
+     */
+    void setFixedInternalSampleRate(const double sampleRate)
+    {
+        jassert(sampleRate >= 0.0);
+        fixedInternalSampleRate = sampleRate;
+    }
+
+    /**
+     * Let the load pick the precision, block by block:  render in double
+     * while there's headroom and drop to single under load, whichever
+     * processBlock() the host calls.  Switching hands the synth's state
+     * over and crossfades.  Both paths are built, so it takes effect at the
+     * next prepareToPlay().  Not available with a fixed internal block size
+     * or sample rate:  their adapters hold audio that can't be handed over.
+     */
+    void setAdaptivePrecision(const bool shouldAdapt)
+    {
+        adaptivePrecision = shouldAdapt;
+    }
+
+    // Load levels (1.0 = 100%) for dropping to single and going back to double.  Safe to call from any thread.
+    void setAdaptivePrecisionThresholds(const double downgradeLoad, const double upgradeLoad)
+    {
+        pPrecisionSelector->setThresholds(downgradeLoad, upgradeLoad);
+    }
+
+    // Times adaptive precision has switched since the last prepareToPlay().  Safe to call from any thread.
+    juce::uint64 getNumPrecisionSwitches() const { return pPrecisionSelector->getNumSwitches(); }
+
+    /**
+     * What this instance holds:  the arena and the buffers carved from it,
+     * the synths, guards and adapters, any capture ring and the logger's
+     * backlog, plus the tables shared with other instances.  Allocates, so
+     * not for the audio thread.
+     */
+    juce_igutil::MemoryReport getMemoryReport();
+
+    // How long the first instance took to open the shared log file and start the logging thread.
+    static long long getLoggingStartupNanos();
+
+    // Heap allocations made rendering in processBlock() since the last prepareToPlay().  Its log messages
+    // are counted apart, in AllocationCounter's process (logging) phase.  0 without COUNT_ALLOCATIONS.
+    juce::uint64 getProcessAllocations() const { return processAllocations.load(std::memory_order_relaxed); }
+
+    /**
+     * Capture every block's input, MIDI and timing to this file, for replay
+     * with a BlockReplayer.  File() turns it off.  Takes effect at the next
+     * prepareToPlay(), which starts the capture over.
+     */
+    void setCaptureFile(const juce::File& file)
+    {
+        captureFile = file;
     }
 
 private:
 
-    // profiler and logger objects
+    // profiler and logger objects.  The loggers are shared by every instance in the
+    // process; the profiler is created at the first prepareToPlay().
     std::shared_ptr<juce::FileLogger> pLogger;
     std::shared_ptr<juce_igutil::MTLogger> pMTL;
     std::unique_ptr<juce_igutil::Profiler> pProfiler;
+    std::unique_ptr<juce_igutil::LoadMeter> pLoadMeter;
+
+    /**
+     * Create what the given precisions need (the synth and guard for each)
+     * and free what they don't, so an instance only ever holds the path its
+     * host uses.  Called from prepareToPlay().
+     */
+    void buildProcessingPaths(const bool needFloat, const bool needDouble);
 
-    // The synths - one per processing type.  
+    // The synths - one per processing type, only built for the precision in use.
     std::unique_ptr<audio_processing_float::SineWaveSynthesiser> pFloatSynth;
     std::unique_ptr<audio_processing_double::SineWaveSynthesiser> pDoubleSynth;
 
+    // Fixed internal sample rate and block size modes:  0 = off.  When on, adapters wrap the synths.
+    double fixedInternalSampleRate = 0.0;
+    int fixedInternalBlockSize = 0;
+    std::unique_ptr<audio_processing_float::FixedRateAdapter> pFloatRateAdapter;
+    std::unique_ptr<audio_processing_double::FixedRateAdapter> pDoubleRateAdapter;
+    std::unique_ptr<audio_processing_float::FixedBlockAdapter> pFloatBlockAdapter;
+    std::unique_ptr<audio_processing_double::FixedBlockAdapter> pDoubleBlockAdapter;
+
+    // What processBlock() renders with:  either the synths or the outermost adapters around them.
+    audio_processing_float::ProcessorNode * pFloatNode = nullptr;
+    audio_processing_double::ProcessorNode * pDoubleNode = nullptr;
+
+    // Denormal / NaN guards - one per processing type, built with the synths - and the stages they check.
+    enum GuardStage { guardStageInput = 0, guardStageRender, guardStageOutput };
+    std::unique_ptr<audio_processing_float::SampleGuard> pFloatGuard;
+    std::unique_ptr<audio_processing_double::SampleGuard> pDoubleGuard;
+    bool sampleGuardEnabled = true;
+    bool sampleGuardSanitising = false;
+
+    // All scratch and conversion buffers are carved out of this at prepare time,
+    // so nothing allocates in processBlock().
+    juce_igutil::AlignedArena arena;
+
     // Buffer for testing performance with the "copy float to double buffer" 
-    // scenario.
+    // scenario.  Refers to memory in the arena.
     std::unique_ptr<juce::AudioBuffer<double>> pDoubleBuffer;
 
-    // set in the processBlock() functions, read by editor.
-    juce::String & precisionText;
+    // Adaptive precision.  Requested, and whether this prepare allows it.
+    bool adaptivePrecision = false;
+    bool adaptiveActive = false;
+    std::unique_ptr<juce_igutil::PrecisionSelector> pPrecisionSelector;
+
+    // Audio thread only:  the precision being rendered in, and how much of the crossfade
+    // from the other one is left.
+    static const int precisionCrossfadeSamples = 256;
+    bool renderingInDouble = false;
+    int crossfadeRemaining = 0;
+
+    // Node state handed over on a switch.  Sized at prepare time.
+    std::vector<double> nodeState;
+
+    // The float counterpart of pDoubleBuffer, for adaptive precision.  Refers to memory in the arena.
+    std::unique_ptr<juce::AudioBuffer<float>> pFloatBuffer;
+
+    // Render a host block in the precision the selector picked, crossfading after a switch.
+    void renderAdaptive(juce::AudioBuffer<float>& buffer);
+    void renderAdaptive(juce::AudioBuffer<double>& buffer);
+
+    // Render a block of at most the prepared size in one precision, converting if it isn't the block's own.
+    void renderInPrecision(juce::AudioBuffer<float>& block, const bool inDouble);
+    void renderInPrecision(juce::AudioBuffer<double>& block, const bool inDouble);
+
+    // Hand the state of the node being left over to the other precision's node.
+    void transferNodeState(const bool toDouble);
+
+    // Block capture, when there's a capture file.  Created at prepare time.
+    juce::File captureFile;
+    std::unique_ptr<juce_igutil::BlockCapture> pCapture;
+
+    // Allocations counted in processBlock(), and the blocks that made any.  Written by the audio thread.
+    std::atomic<juce::uint64> processAllocations { 0 };
+    juce::uint64 numAllocatingBlocks = 0;
+
+    // Count what the block allocated between the two counts, logging when a block allocates.
+    void checkProcessAllocations(
+        const juce_igutil::AllocationCounter::Counts& before,
+        const juce_igutil::AllocationCounter::Counts& after);
+
+    // Only used when RUN_BENCHMARKS is defined.
+    std::unique_ptr<std::thread> pBenchmarkThread;
+
+    // Update the metrics after each block and, every so often, publish them to the editor.
+    void updateMetrics(
+        const juce_igutil::ProcessorMetrics::Precision precision, 
+        const long long blockNanos, 
+        const int numSamples);
+
+    // Metrics, written only by the audio thread and handed to the editor through the exchange.
+    static const int metricsPublishInterval = 16;
+    juce_igutil::MetricsExchange metricsExchange;
+    juce_igutil::ProcessorMetrics metrics;
+    int blocksSincePublish = 0;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DoublePrecisionPocAudioProcessor)
 };
@@ -0,0 +1,485 @@
+/**
+ * Convolver
+ *
+ * Zero-latency convolution with long impulse responses:  uniformly
+ * partitioned FFT convolution with a frequency-domain delay line, and
+ * optionally the tail partitions worked out on a background thread.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "ProcessorNode.h"
+#include "RealFFT.h"
+
+#include "../juce_igutil/MTLogger.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * The impulse response is cut into partitions of B samples, and each is
+ * transformed once, at prepare time, with a 2B FFT.  Input is transformed
+ * the same way into a ring of spectra (the frequency-domain delay line), and
+ * each output block is the sum over partitions of input spectrum times
+ * partition spectrum, transformed back, overlap-added.
+ *
+ * Host blocks don't have to line up with partitions.  Every call transforms
+ * the partly filled input block and multiplies it by the first partition;
+ * the sum over all the older blocks is only done once, when a block starts.
+ * So there's no latency, and a call costs two FFTs and one partition
+ * multiply plus, once per partition, the rest of the sum.
+ *
+ * With a 10 s response that rest is thousands of spectrum multiplies, all at
+ * once.  With tail offloading, only the first headPartitions partitions are
+ * summed on the audio thread.  The rest only needs input at least
+ * headPartitions blocks old, so a worker thread starts on it as soon as it
+ * sees that input is in and has headPartitions - 1 blocks to finish.
+ *
+ * The audio thread never waits for the worker, nor wakes it:  it only stores
+ * an atomic to hand the tail over.  The worker polls for it, spinning
+ * briefly and then yielding, so it keeps a core busy while offloading is on.
+ * prepare() moves partitions back to the audio thread until the slack
+ * covers several worst-case polls.  If the tail is still late, the audio
+ * thread sums it itself, abandoning the worker's copy if it was started,
+ * and counts it.
+ *
+ * Everything is allocated in prepare(); the buffers all come from the arena.
+ */
+class Convolver : public ProcessorNode
+{
+public:
+
+    /**
+     * Construct.
+     *
+     * @param _pMTL - MT logger
+     * @param _partitionSize - partition size B, a power of two; 0 means the
+     *                       smallest power of two at least the maximum block size
+     * @param _headPartitions - partitions summed on the audio thread; the
+     *                       rest go to a worker thread.  0 means no worker.
+     *                       Needs to be at least 2 to give the worker any time;
+     *                       prepare() raises it if that time is too short.
+     */
+    Convolver(
+        std::shared_ptr<juce_igutil::MTLogger> _pMTL,
+        const int _partitionSize = 0,
+        const int _headPartitions = 0
+    ):
+        pMTL(_pMTL),
+        requestedPartitionSize(_partitionSize),
+        requestedHeadPartitions(_headPartitions)
+    {
+        jassert(requestedPartitionSize == 0 || juce::isPowerOfTwo(requestedPartitionSize));
+        jassert(requestedHeadPartitions == 0 || requestedHeadPartitions >= 2);
+    }
+
+    // Destruct
+    virtual ~Convolver()
+    {
+        stopTailThread();
+    }
+
+    /**
+     * Set the impulse response.  Channel c of the audio uses channel c of
+     * the response, or its last channel if it has fewer.  Not real-time
+     * safe; takes effect at the next prepare().
+     */
+    void loadImpulseResponse(const juce::AudioBuffer<SAMPLE_TYPE> & ir)
+    {
+        impulseResponse.makeCopyOf(ir);
+    }
+
+    // Partition the response and carve out every buffer.  Starts the worker thread if used.
+    void prepare(
+        const double sampleRate,
+        const int maxBlockSize,
+        const int _numChannels,
+        juce_igutil::AlignedArena & arena) override
+    {
+        stopTailThread();
+
+        numChannels = _numChannels;
+        partitionSize = requestedPartitionSize > 0 ? requestedPartitionSize
+            : juce::nextPowerOfTwo(juce::jmax(maxBlockSize, minimumPartitionSize));
+        fft.prepare(2 * partitionSize, arena);
+        numBins = fft.getNumBins();
+
+        // round up so every spectrum in a ring starts 64-byte aligned
+        const int stride = juce_igutil::AlignedArena::alignment / sizeof(SAMPLE_TYPE);
+        binStride = (numBins + stride - 1) / stride * stride;
+
+        const int irLength = impulseResponse.getNumSamples();
+        hasImpulseResponse = impulseResponse.getNumChannels() > 0 && irLength > 0;
+        numPartitions = juce::jmax(1, (irLength + partitionSize - 1) / partitionSize);
+
+        // the worker has headPartitions - 1 blocks to finish in; make that cover minimumTailSlackMicros
+        const int slackPartitions = (int) std::ceil(minimumTailSlackMicros * 1.0e-6 * sampleRate / partitionSize);
+        const int usedHeadPartitions = requestedHeadPartitions >= 2 ? juce::jmax(requestedHeadPartitions, 1 + slackPartitions) : 0;
+        if (usedHeadPartitions > requestedHeadPartitions) {
+            pMTL->debug(juce::String("CONVOLVER:  ") + juce::String(usedHeadPartitions) + juce::String(" head partitions, not ") +
+                juce::String(requestedHeadPartitions) + juce::String(", to give the worker enough time"));
+        }
+
+        offloading = usedHeadPartitions >= 2 && numPartitions > usedHeadPartitions;
+        headPartitions = offloading ? usedHeadPartitions : numPartitions;
+
+        // While the worker sums the tail for a block, the audio thread keeps
+        // writing new input spectra.  The extra headPartitions slots stop
+        // those from landing on anything the worker is still reading.
+        numSegments = numPartitions + (offloading ? headPartitions : 0);
+
+        channels.clear();
+        channels.resize((size_t) numChannels);
+        for (int c = 0; c < numChannels; ++c) {
+            Channel & channel = channels[(size_t) c];
+            arena.allocate(channel.pIrRe, (size_t) (numPartitions * binStride));
+            arena.allocate(channel.pIrIm, (size_t) (numPartitions * binStride));
+            arena.allocate(channel.pSegmentsRe, (size_t) (numSegments * binStride));
+            arena.allocate(channel.pSegmentsIm, (size_t) (numSegments * binStride));
+            arena.allocate(channel.pHeadRe, (size_t) binStride);
+            arena.allocate(channel.pHeadIm, (size_t) binStride);
+            arena.allocate(channel.pSumRe, (size_t) binStride);
+            arena.allocate(channel.pSumIm, (size_t) binStride);
+            arena.allocate(channel.pInput, (size_t) (2 * partitionSize));
+            arena.allocate(channel.pOutput, (size_t) (2 * partitionSize));
+            arena.allocate(channel.pOverlap, (size_t) partitionSize);
+            if (offloading) {
+                arena.allocate(channel.pTailRe, (size_t) (headPartitions * binStride));
+                arena.allocate(channel.pTailIm, (size_t) (headPartitions * binStride));
+            }
+
+            // transform each partition of the response, zero padded to 2B
+            if (hasImpulseResponse) {
+                const int irChannel = juce::jmin(c, impulseResponse.getNumChannels() - 1);
+                for (int p = 0; p < numPartitions; ++p) {
+                    const int numToCopy = juce::jmin(partitionSize, irLength - p * partitionSize);
+                    juce::FloatVectorOperations::clear(channel.pOutput, 2 * partitionSize);
+                    juce::FloatVectorOperations::copy(channel.pOutput, impulseResponse.getReadPointer(irChannel, p * partitionSize), numToCopy);
+                    fft.forward(channel.pOutput, channel.pIrRe + p * binStride, channel.pIrIm + p * binStride);
+                }
+                juce::FloatVectorOperations::clear(channel.pOutput, 2 * partitionSize);
+            }
+        }
+
+        inputPosition = 0;
+        currentSegment = 0;
+        blockIndex = 0;
+        numLateTails.store(0);
+
+        if (offloading) {
+            pTailSlots.reset(new TailSlot[(size_t) headPartitions]);
+            threadShouldExit.store(false);
+            pTailThread.reset(new std::thread([this]() { runTailThread(); }));
+        }
+
+        pMTL->debug(juce::String("CONVOLVER:  ") + juce::String(irLength) + juce::String(" samples in ") +
+            juce::String(numPartitions) + juce::String(" partitions of ") + juce::String(partitionSize) +
+            (offloading ? juce::String(", ") + juce::String(numPartitions - headPartitions) + juce::String(" on the worker thread") : juce::String()));
+    }
+
+    // Convolve in place.  Any number of samples; no latency.
+    void process(
+        juce::AudioBuffer<SAMPLE_TYPE> & buffer,
+        int startSample,
+        int numSamples) override
+    {
+        if ( !hasImpulseResponse ) return;
+
+        const int numChannelsToUse = juce::jmin(numChannels, buffer.getNumChannels());
+
+        while (numSamples > 0) {
+            const int numToProcess = juce::jmin(numSamples, partitionSize - inputPosition);
+            const bool isNewBlock = inputPosition == 0;
+
+            // the worker's sum of the tail for this block, if there is one yet
+            const int tailSlot = (isNewBlock && offloading) ? acquireTail() : -1;
+
+            for (int c = 0; c < numChannelsToUse; ++c) {
+                processChannel(channels[(size_t) c], buffer.getWritePointer(c, startSample), numToProcess, isNewBlock, tailSlot);
+            }
+
+            if (tailSlot >= 0) {
+                pTailSlots[(size_t) tailSlot].state.store(tailIdle, std::memory_order_relaxed);
+            }
+
+            startSample += numToProcess;
+            numSamples -= numToProcess;
+            inputPosition += numToProcess;
+
+            if (inputPosition == partitionSize) {
+                finishBlock();
+            }
+        }
+    }
+
+    // Stop the worker and report how often it was late.
+    void releaseResources() override
+    {
+        stopTailThread();
+        const juce::uint64 late = numLateTails.load();
+        if (late > 0) {
+            pMTL->warning(juce::String("CONVOLVER:  tail was late ") + juce::String(late) + juce::String(" times."));
+        }
+    }
+
+    // Blocks where the worker hadn't finished the tail in time.  Safe to call from any thread.
+    inline juce::uint64 getNumLateTails() const { return numLateTails.load(std::memory_order_relaxed); }
+
+    inline int getPartitionSize() const { return partitionSize; }
+    inline int getNumPartitions() const { return numPartitions; }
+
+private:
+
+    static const int minimumPartitionSize = 32;
+
+    // The worker checks for requested tails this many times before it starts yielding between checks.
+    static const int tailSpinPolls = 1000;
+
+    // Longest the worker is taken to go between checks, allowing for a yield or a preemption, and the
+    // least slack prepare() leaves it:  several of those.
+    static constexpr double maximumTailPollMicros = 1000.0;
+    static constexpr double minimumTailSlackMicros = 4.0 * maximumTailPollMicros;
+
+    // acquireTail() when the audio thread has to sum the tail itself.
+    static const int lateTail = -2;
+
+    // Only the worker moves a slot from requested to busy to done.  The audio thread requests,
+    // abandons a late one, and goes back to idle once it has used the sum.
+    enum TailState { tailIdle = 0, tailRequested, tailBusy, tailDone, tailAbandoned };
+
+    // One tail sum in flight:  for the block headPartitions blocks after the one whose spectrum is at baseSegment.
+    struct TailSlot {
+        std::atomic<int> state { tailIdle };
+        std::atomic<int> baseSegment { 0 };
+    };
+
+    // Everything one channel needs.  All of it refers to arena memory.
+    struct Channel {
+        SAMPLE_TYPE * pIrRe = nullptr;          // [partition][bin]
+        SAMPLE_TYPE * pIrIm = nullptr;
+        SAMPLE_TYPE * pSegmentsRe = nullptr;    // [segment][bin], the frequency-domain delay line
+        SAMPLE_TYPE * pSegmentsIm = nullptr;
+        SAMPLE_TYPE * pHeadRe = nullptr;        // sum over the older blocks, done once per block
+        SAMPLE_TYPE * pHeadIm = nullptr;
+        SAMPLE_TYPE * pSumRe = nullptr;         // head plus the current block
+        SAMPLE_TYPE * pSumIm = nullptr;
+        SAMPLE_TYPE * pInput = nullptr;         // current input block, zero padded to 2B
+        SAMPLE_TYPE * pOutput = nullptr;        // 2B
+        SAMPLE_TYPE * pOverlap = nullptr;       // second half of the last full block's output
+        SAMPLE_TYPE * pTailRe = nullptr;        // [tail slot][bin]
+        SAMPLE_TYPE * pTailIm = nullptr;
+    };
+
+    // sum += x * h, complex, over numBins bins
+    static inline void multiplyAccumulate(
+        SAMPLE_TYPE * juce_restrict pSumRe, SAMPLE_TYPE * juce_restrict pSumIm,
+        const SAMPLE_TYPE * juce_restrict pXRe, const SAMPLE_TYPE * juce_restrict pXIm,
+        const SAMPLE_TYPE * juce_restrict pHRe, const SAMPLE_TYPE * juce_restrict pHIm,
+        const int numBins)
+    {
+        for (int b = 0; b < numBins; ++b) {
+            pSumRe[b] += pXRe[b] * pHRe[b] - pXIm[b] * pHIm[b];
+            pSumIm[b] += pXRe[b] * pHIm[b] + pXIm[b] * pHRe[b];
+        }
+    }
+
+    // Add numToProcess new samples to the current block, and output the convolution for them.
+    void processChannel(Channel & channel, SAMPLE_TYPE * pData, const int numToProcess, const bool isNewBlock, const int tailSlot)
+    {
+        juce::FloatVectorOperations::copy(channel.pInput + inputPosition, pData, numToProcess);
+
+        SAMPLE_TYPE * pCurrentRe = channel.pSegmentsRe + currentSegment * binStride;
+        SAMPLE_TYPE * pCurrentIm = channel.pSegmentsIm + currentSegment * binStride;
+        fft.forward(channel.pInput, pCurrentRe, pCurrentIm);
+
+        // older blocks:  block k - i is i segments on from the current one
+        if (isNewBlock) {
+            juce::FloatVectorOperations::clear(channel.pHeadRe, numBins);
+            juce::FloatVectorOperations::clear(channel.pHeadIm, numBins);
+            int segment = currentSegment;
+            for (int i = 1; i < headPartitions; ++i) {
+                if (++segment == numSegments) segment = 0;
+                multiplyAccumulate(channel.pHeadRe, channel.pHeadIm,
+                    channel.pSegmentsRe + segment * binStride, channel.pSegmentsIm + segment * binStride,
+                    channel.pIrRe + i * binStride, channel.pIrIm + i * binStride, numBins);
+            }
+            if (tailSlot >= 0) {
+                juce::FloatVectorOperations::add(channel.pHeadRe, channel.pTailRe + tailSlot * binStride, numBins);
+                juce::FloatVectorOperations::add(channel.pHeadIm, channel.pTailIm + tailSlot * binStride, numBins);
+            }
+            else if (tailSlot == lateTail) {
+                addTail(channel, channel.pHeadRe, channel.pHeadIm, lateTailBaseSegment, nullptr);
+            }
+        }
+
+        juce::FloatVectorOperations::copy(channel.pSumRe, channel.pHeadRe, numBins);
+        juce::FloatVectorOperations::copy(channel.pSumIm, channel.pHeadIm, numBins);
+        multiplyAccumulate(channel.pSumRe, channel.pSumIm, pCurrentRe, pCurrentIm, channel.pIrRe, channel.pIrIm, numBins);
+        fft.inverse(channel.pSumRe, channel.pSumIm, channel.pOutput);
+
+        juce::FloatVectorOperations::add(pData, channel.pOutput + inputPosition, channel.pOverlap + inputPosition, numToProcess);
+    }
+
+    // The current block is full:  keep its overlap, move the delay line on, and hand the tail to the worker.
+    void finishBlock()
+    {
+        for (Channel & channel : channels) {
+            juce::FloatVectorOperations::copy(channel.pOverlap, channel.pOutput + partitionSize, partitionSize);
+            juce::FloatVectorOperations::clear(channel.pInput, partitionSize);
+        }
+
+        if (offloading) {
+            // the tail for block blockIndex + headPartitions uses this block and older
+            TailSlot & slot = pTailSlots[(size_t) (blockIndex % (juce::uint64) headPartitions)];
+            slot.baseSegment.store(currentSegment, std::memory_order_relaxed);
+            slot.state.store(tailRequested, std::memory_order_release);
+        }
+
+        currentSegment = currentSegment > 0 ? currentSegment - 1 : numSegments - 1;
+        ++blockIndex;
+        inputPosition = 0;
+    }
+
+    /**
+     * Get this block's tail sum.  Normally the worker has finished it.  If
+     * not, take the slot back from the worker, whether or not it has
+     * started, and let processChannel() sum the tail.  Never waits.
+     *
+     * @return the slot index, lateTail, or -1 in the first blocks, which have no tail.
+     */
+    int acquireTail()
+    {
+        const int slotIndex = (int) (blockIndex % (juce::uint64) headPartitions);
+        TailSlot & slot = pTailSlots[(size_t) slotIndex];
+
+        int state = slot.state.load(std::memory_order_acquire);
+        if (state == tailIdle) return -1;
+        if (state == tailDone) return slotIndex;
+
+        numLateTails.store(numLateTails.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        // the worker can only move it on to busy and then done, so this settles in a step or two
+        while (state != tailDone) {
+            if (slot.state.compare_exchange_weak(state, tailAbandoned, std::memory_order_acq_rel)) {
+                lateTailBaseSegment = slot.baseSegment.load(std::memory_order_relaxed);
+                return lateTail;
+            }
+        }
+        return slotIndex;
+    }
+
+    /**
+     * Add the tail partitions to a sum:  partition headPartitions + j times
+     * the spectrum j blocks before the base.  With a slot, stop as soon as
+     * it's no longer busy, i.e. the audio thread has abandoned it.
+     *
+     * @return false if it stopped early.
+     */
+    bool addTail(const Channel & channel, SAMPLE_TYPE * pRe, SAMPLE_TYPE * pIm, const int baseSegment, const TailSlot * pSlot)
+    {
+        int segment = baseSegment;
+        for (int p = headPartitions; p < numPartitions; ++p) {
+            if (pSlot != nullptr && pSlot->state.load(std::memory_order_relaxed) != tailBusy) return false;
+            multiplyAccumulate(pRe, pIm,
+                channel.pSegmentsRe + segment * binStride, channel.pSegmentsIm + segment * binStride,
+                channel.pIrRe + p * binStride, channel.pIrIm + p * binStride, numBins);
+            if (++segment == numSegments) segment = 0;
+        }
+        return true;
+    }
+
+    // Worker:  sum the tail into a slot.  An abandoned slot is left as the audio thread set it.
+    void computeTail(const int slotIndex)
+    {
+        TailSlot & slot = pTailSlots[(size_t) slotIndex];
+        const int baseSegment = slot.baseSegment.load(std::memory_order_relaxed);
+        for (Channel & channel : channels) {
+            SAMPLE_TYPE * pTailRe = channel.pTailRe + slotIndex * binStride;
+            SAMPLE_TYPE * pTailIm = channel.pTailIm + slotIndex * binStride;
+            juce::FloatVectorOperations::clear(pTailRe, numBins);
+            juce::FloatVectorOperations::clear(pTailIm, numBins);
+            if ( !addTail(channel, pTailRe, pTailIm, baseSegment, &slot) ) return;
+        }
+
+        int state = tailBusy;
+        slot.state.compare_exchange_strong(state, tailDone, std::memory_order_release);
+    }
+
+    // Worker:  sum every requested tail, oldest first, then poll for more.
+    void runTailThread()
+    {
+        int nextSlot = 0;
+        int idlePolls = 0;
+        while ( !threadShouldExit.load() ) {
+            bool didWork = false;
+            for (int i = 0; i < headPartitions; ++i) {
+                const int slotIndex = (nextSlot + i) % headPartitions;
+                int state = tailRequested;
+                if (pTailSlots[(size_t) slotIndex].state.compare_exchange_strong(state, tailBusy, std::memory_order_acquire)) {
+                    computeTail(slotIndex);
+                    nextSlot = (slotIndex + 1) % headPartitions;
+                    didWork = true;
+                    break;
+                }
+            }
+            if (didWork) {
+                idlePolls = 0;
+            }
+            else if (++idlePolls > tailSpinPolls) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void stopTailThread()
+    {
+        if (pTailThread) {
+            threadShouldExit.store(true);
+            pTailThread->join();
+            pTailThread.reset();
+        }
+    }
+
+    std::shared_ptr<juce_igutil::MTLogger> pMTL;
+
+    const int requestedPartitionSize;
+    const int requestedHeadPartitions;
+
+    juce::AudioBuffer<SAMPLE_TYPE> impulseResponse;
+    bool hasImpulseResponse = false;
+
+    RealFFT fft;
+    int numChannels = 0;
+    int partitionSize = 0;
+    int numBins = 0;
+    int binStride = 0;
+    int numPartitions = 0;
+    int headPartitions = 0;
+    int numSegments = 0;
+    bool offloading = false;
+
+    std::vector<Channel> channels;
+
+    // where the current block is:  samples into it, its delay line slot, and its number
+    int inputPosition = 0;
+    int currentSegment = 0;
+    juce::uint64 blockIndex = 0;
+
+    // tail offloading
+    std::unique_ptr<TailSlot[]> pTailSlots;
+    int lateTailBaseSegment = 0;    // audio thread only
+    std::unique_ptr<std::thread> pTailThread;
+    std::atomic<bool> threadShouldExit { false };
+    std::atomic<juce::uint64> numLateTails { 0 };
+};
+
+} // AUDIO_PROCESSING_NAMESPACE
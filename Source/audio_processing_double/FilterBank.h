@@ -0,0 +1,382 @@
+/**
+ * FilterBank
+ *
+ * Many biquads or state-variable filters run side by side, one SIMD lane
+ * per filter.  Coefficients and state are kept in structure-of-arrays
+ * layout, so a group of filters is one vector op per multiply-add.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <math.h>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "ProcessorNode.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * Each filter reads one channel of the buffer.  The outputs of all the
+ * filters on a channel are summed and replace that channel; channels with
+ * no filters are left alone.  So one filter per channel is an ordinary
+ * multichannel filter, and several on one channel make a parallel bank
+ * (graphic EQ, vocoder bands, per-voice filters mixed down).
+ *
+ * Filters are processed in groups of as many as fit in a SIMDRegister of
+ * SAMPLE_TYPE (4 floats or 2 doubles with SSE / NEON).  Each group's input
+ * is interleaved into a scratch block, filtered with vector ops, then added
+ * back into the channels.
+ *
+ * Coefficients are always designed in double, then rounded to SAMPLE_TYPE.
+ * Rounding matters most for low cutoffs, where the poles sit right next to
+ * the unit circle - that's where the double version earns its keep.
+ */
+class FilterBank : public ProcessorNode
+{
+public:
+
+    // Biquads (transposed direct form II) are cheapest; SVFs behave better when modulated.
+    enum Topology { topologyBiquad = 0, topologySVF };
+
+    enum FilterType { typeLowPass = 0, typeHighPass, typeBandPass, typeNotch, typePeak };
+
+    using Register = juce::dsp::SIMDRegister<SAMPLE_TYPE>;
+    static constexpr int numLanes = (int) Register::SIMDNumElements;
+
+    /**
+     * Construct.
+     *
+     * @param _topology - biquad or SVF, for every filter in the bank
+     * @param _maxFilters - how many filters can be set
+     */
+    FilterBank(const Topology _topology, const int _maxFilters):
+        topology(_topology),
+        maxFilters(_maxFilters),
+        numGroups((_maxFilters + numLanes - 1) / numLanes),
+        specs((size_t) (numGroups * numLanes))
+    {
+        // empty
+    }
+
+    // Destruct
+    virtual ~FilterBank() = default;
+
+    /**
+     * Set up one filter.  Until prepare() this just records the settings;
+     * after it, it also recomputes that filter's coefficients, which doesn't
+     * allocate but must happen on the audio thread (or while not playing).
+     *
+     * @param index - which filter, 0 to maxFilters - 1
+     * @param channel - the channel it reads and adds into, or -1 to disable it
+     * @param type - response
+     * @param frequency - cutoff or centre frequency, Hz
+     * @param q - resonance, 0.7071 for Butterworth low / high pass
+     * @param gainDecibels - peak gain, only used by typePeak
+     */
+    void setFilter(
+        const int index,
+        const int channel,
+        const FilterType type,
+        const double frequency,
+        const double q = 0.7071067811865476,
+        const double gainDecibels = 0.0)
+    {
+        jassert(index >= 0 && index < maxFilters);
+        specs[(size_t) index] = { channel, type, frequency, q, gainDecibels };
+        if (pCoefficients != nullptr) {
+            updateCoefficients(index);
+            updateChannelsUsed();
+        }
+    }
+
+    // Carve coefficients, state and scratch out of the arena and design every filter.
+    void prepare(
+        const double _sampleRate,
+        const int _maxBlockSize,
+        const int _numChannels,
+        juce_igutil::AlignedArena & arena) override
+    {
+        sampleRate = _sampleRate;
+        maxBlockSize = _maxBlockSize;
+        numChannels = _numChannels;
+
+        arena.allocate(pCoefficients, (size_t) (numGroups * numCoefficients * numLanes));
+        arena.allocate(pState, (size_t) (numGroups * numStates * numLanes));
+        arena.allocate(pInterleaved, (size_t) (maxBlockSize * numLanes));
+        arena.allocateChannels(pSums, numChannels, (size_t) maxBlockSize);
+        pChannels = static_cast<int *>(arena.allocateBytes(sizeof(int) * (size_t) (numGroups * numLanes)));
+        pChannelUsed = static_cast<bool *>(arena.allocateBytes(sizeof(bool) * (size_t) numChannels));
+
+        for (int i = 0; i < numGroups * numLanes; ++i) {
+            updateCoefficients(i);
+        }
+        updateChannelsUsed();
+    }
+
+    // Filter numSamples samples in place.
+    void process(
+        juce::AudioBuffer<SAMPLE_TYPE> & buffer,
+        int startSample,
+        int numSamples) override
+    {
+        while (numSamples > 0) {
+            const int numToProcess = juce::jmin(numSamples, maxBlockSize);
+            processChunk(buffer, startSample, numToProcess);
+            startSample += numToProcess;
+            numSamples -= numToProcess;
+        }
+    }
+
+    // Clear the filter state.
+    void releaseResources() override
+    {
+        if (pState != nullptr) {
+            juce::FloatVectorOperations::clear(pState, numGroups * numStates * numLanes);
+        }
+    }
+
+    inline int getMaxFilters() const { return maxFilters; }
+
+private:
+
+    // enough for either topology
+    static const int numCoefficients = 6;
+    static const int numStates = 2;
+
+    struct Spec {
+        int channel = -1;
+        FilterType type = typeLowPass;
+        double frequency = 1000.0;
+        double q = 0.7071067811865476;
+        double gainDecibels = 0.0;
+    };
+
+    // Lane `lane` of coefficient `c` in group `group`.
+    inline SAMPLE_TYPE & coefficient(const int group, const int c, const int lane)
+    {
+        return pCoefficients[(group * numCoefficients + c) * numLanes + lane];
+    }
+
+    // Design one filter, in double, and store it in its lane.  Unused lanes get all zeros (silence).
+    void updateCoefficients(const int index)
+    {
+        const Spec & spec = specs[(size_t) index];
+        const int group = index / numLanes;
+        const int lane = index % numLanes;
+
+        const bool active = index < maxFilters && spec.channel >= 0 && spec.channel < numChannels;
+        pChannels[index] = active ? spec.channel : -1;
+
+        double c[numCoefficients] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+        if (active) {
+            if (topology == topologyBiquad) designBiquad(spec, c);
+            else designSVF(spec, c);
+        }
+        for (int i = 0; i < numCoefficients; ++i) {
+            coefficient(group, i, lane) = (SAMPLE_TYPE) c[i];
+        }
+    }
+
+    // Which channels have at least one filter, and so get replaced by the filter outputs.
+    void updateChannelsUsed()
+    {
+        for (int chan = 0; chan < numChannels; ++chan) {
+            pChannelUsed[chan] = false;
+        }
+        for (int i = 0; i < numGroups * numLanes; ++i) {
+            if (pChannels[i] >= 0) pChannelUsed[pChannels[i]] = true;
+        }
+    }
+
+    /**
+     * RBJ cookbook biquad, normalised so a0 = 1.
+     * c = { b0, b1, b2, a1, a2, unused }
+     */
+    void designBiquad(const Spec & spec, double * c) const
+    {
+        const double w0 = juce::MathConstants<double>::twoPi * juce::jlimit(1.0, 0.49 * sampleRate, spec.frequency) / sampleRate;
+        const double cosW0 = std::cos(w0);
+        const double alpha = std::sin(w0) / (2.0 * spec.q);
+        const double A = std::pow(10.0, spec.gainDecibels / 40.0);
+
+        double b0 = 1.0, b1 = 0.0, b2 = 0.0, a0 = 1.0, a1 = 0.0, a2 = 0.0;
+        switch (spec.type) {
+            case typeLowPass:
+                b0 = (1.0 - cosW0) / 2.0; b1 = 1.0 - cosW0; b2 = b0;
+                a0 = 1.0 + alpha; a1 = -2.0 * cosW0; a2 = 1.0 - alpha;
+                break;
+            case typeHighPass:
+                b0 = (1.0 + cosW0) / 2.0; b1 = -(1.0 + cosW0); b2 = b0;
+                a0 = 1.0 + alpha; a1 = -2.0 * cosW0; a2 = 1.0 - alpha;
+                break;
+            case typeBandPass:
+                b0 = alpha; b1 = 0.0; b2 = -alpha;
+                a0 = 1.0 + alpha; a1 = -2.0 * cosW0; a2 = 1.0 - alpha;
+                break;
+            case typeNotch:
+                b0 = 1.0; b1 = -2.0 * cosW0; b2 = 1.0;
+                a0 = 1.0 + alpha; a1 = -2.0 * cosW0; a2 = 1.0 - alpha;
+                break;
+            case typePeak:
+                b0 = 1.0 + alpha * A; b1 = -2.0 * cosW0; b2 = 1.0 - alpha * A;
+                a0 = 1.0 + alpha / A; a1 = -2.0 * cosW0; a2 = 1.0 - alpha / A;
+                break;
+        }
+
+        c[0] = b0 / a0; c[1] = b1 / a0; c[2] = b2 / a0;
+        c[3] = a1 / a0; c[4] = a2 / a0;
+    }
+
+    /**
+     * Trapezoidal (zero-delay feedback) SVF, after Andrew Simper.
+     * c = { a1, a2, a3, m0, m1, m2 }, output = m0 * in + m1 * band + m2 * low.
+     */
+    void designSVF(const Spec & spec, double * c) const
+    {
+        const double g = std::tan(juce::MathConstants<double>::pi * juce::jlimit(1.0, 0.49 * sampleRate, spec.frequency) / sampleRate);
+        const double A = std::pow(10.0, spec.gainDecibels / 40.0);
+        double k = 1.0 / spec.q;
+
+        double m0 = 0.0, m1 = 0.0, m2 = 0.0;
+        switch (spec.type) {
+            case typeLowPass:   m2 = 1.0; break;
+            case typeHighPass:  m0 = 1.0; m1 = -k; m2 = -1.0; break;
+            case typeBandPass:  m1 = k; break;  // k * band has unity gain at the centre, like the biquad
+            case typeNotch:     m0 = 1.0; m1 = -k; break;
+            case typePeak:
+                k = 1.0 / (spec.q * A);
+                m0 = 1.0; m1 = k * (A * A - 1.0);
+                break;
+        }
+
+        const double a1 = 1.0 / (1.0 + g * (g + k));
+        c[0] = a1; c[1] = g * a1; c[2] = g * g * a1;
+        c[3] = m0; c[4] = m1; c[5] = m2;
+    }
+
+    // Filter up to maxBlockSize samples.
+    void processChunk(juce::AudioBuffer<SAMPLE_TYPE> & buffer, const int startSample, const int numSamples)
+    {
+        const int numChannelsToUse = juce::jmin(numChannels, buffer.getNumChannels());
+        for (int chan = 0; chan < numChannelsToUse; ++chan) {
+            if (pChannelUsed[chan]) juce::FloatVectorOperations::clear(pSums[chan], numSamples);
+        }
+
+        for (int group = 0; group < numGroups; ++group) {
+            const int * pGroupChannels = pChannels + group * numLanes;
+
+            // interleave the inputs:  sample n of lane l goes to n * numLanes + l
+            bool anyActive = false;
+            for (int lane = 0; lane < numLanes; ++lane) {
+                const int chan = pGroupChannels[lane];
+                if (chan >= 0 && chan < numChannelsToUse) {
+                    const SAMPLE_TYPE * pIn = buffer.getReadPointer(chan, startSample);
+                    for (int n = 0; n < numSamples; ++n) pInterleaved[n * numLanes + lane] = pIn[n];
+                    anyActive = true;
+                }
+                else {
+                    for (int n = 0; n < numSamples; ++n) pInterleaved[n * numLanes + lane] = 0;
+                }
+            }
+            if ( !anyActive ) continue;
+
+            if (topology == topologyBiquad) filterBiquadGroup(group, numSamples);
+            else filterSVFGroup(group, numSamples);
+
+            // and add the outputs back into their channels
+            for (int lane = 0; lane < numLanes; ++lane) {
+                const int chan = pGroupChannels[lane];
+                if (chan >= 0 && chan < numChannelsToUse) {
+                    SAMPLE_TYPE * pSum = pSums[chan];
+                    for (int n = 0; n < numSamples; ++n) pSum[n] += pInterleaved[n * numLanes + lane];
+                }
+            }
+        }
+
+        for (int chan = 0; chan < numChannelsToUse; ++chan) {
+            if (pChannelUsed[chan]) buffer.copyFrom(chan, startSample, pSums[chan], numSamples);
+        }
+    }
+
+    // One group of biquads, over the interleaved block, in place.
+    void filterBiquadGroup(const int group, const int numSamples)
+    {
+        const SAMPLE_TYPE * pC = pCoefficients + group * numCoefficients * numLanes;
+        SAMPLE_TYPE * pS = pState + group * numStates * numLanes;
+
+        const Register b0 = Register::fromRawArray(pC);
+        const Register b1 = Register::fromRawArray(pC + numLanes);
+        const Register b2 = Register::fromRawArray(pC + 2 * numLanes);
+        const Register a1 = Register::fromRawArray(pC + 3 * numLanes);
+        const Register a2 = Register::fromRawArray(pC + 4 * numLanes);
+        Register s1 = Register::fromRawArray(pS);
+        Register s2 = Register::fromRawArray(pS + numLanes);
+
+        for (int n = 0; n < numSamples; ++n) {
+            SAMPLE_TYPE * pSample = pInterleaved + n * numLanes;
+            const Register x = Register::fromRawArray(pSample);
+            const Register y = b0 * x + s1;
+            s1 = b1 * x - a1 * y + s2;
+            s2 = b2 * x - a2 * y;
+            y.copyToRawArray(pSample);
+        }
+
+        s1.copyToRawArray(pS);
+        s2.copyToRawArray(pS + numLanes);
+    }
+
+    // One group of SVFs, over the interleaved block, in place.
+    void filterSVFGroup(const int group, const int numSamples)
+    {
+        const SAMPLE_TYPE * pC = pCoefficients + group * numCoefficients * numLanes;
+        SAMPLE_TYPE * pS = pState + group * numStates * numLanes;
+
+        const Register a1 = Register::fromRawArray(pC);
+        const Register a2 = Register::fromRawArray(pC + numLanes);
+        const Register a3 = Register::fromRawArray(pC + 2 * numLanes);
+        const Register m0 = Register::fromRawArray(pC + 3 * numLanes);
+        const Register m1 = Register::fromRawArray(pC + 4 * numLanes);
+        const Register m2 = Register::fromRawArray(pC + 5 * numLanes);
+        Register ic1eq = Register::fromRawArray(pS);
+        Register ic2eq = Register::fromRawArray(pS + numLanes);
+
+        for (int n = 0; n < numSamples; ++n) {
+            SAMPLE_TYPE * pSample = pInterleaved + n * numLanes;
+            const Register v0 = Register::fromRawArray(pSample);
+            const Register v3 = v0 - ic2eq;
+            const Register v1 = a1 * ic1eq + a2 * v3;
+            const Register v2 = ic2eq + a2 * ic1eq + a3 * v3;
+            ic1eq = v1 + v1 - ic1eq;
+            ic2eq = v2 + v2 - ic2eq;
+            const Register y = m0 * v0 + m1 * v1 + m2 * v2;
+            y.copyToRawArray(pSample);
+        }
+
+        ic1eq.copyToRawArray(pS);
+        ic2eq.copyToRawArray(pS + numLanes);
+    }
+
+    const Topology topology;
+    const int maxFilters;
+    const int numGroups;
+
+    // settings for every lane, including the unused ones at the end of the last group
+    std::vector<Spec> specs;
+
+    double sampleRate = 44100.0;
+    int maxBlockSize = 0;
+    int numChannels = 0;
+
+    // All of these refer to arena memory, 64-byte aligned.
+    SAMPLE_TYPE * pCoefficients = nullptr;   // [group][coefficient][lane]
+    SAMPLE_TYPE * pState = nullptr;          // [group][state][lane]
+    SAMPLE_TYPE * pInterleaved = nullptr;    // [sample][lane], one group at a time
+    SAMPLE_TYPE ** pSums = nullptr;          // [channel][sample]
+    int * pChannels = nullptr;               // channel per lane, -1 if unused
+    bool * pChannelUsed = nullptr;           // per channel
+};
+
+} // AUDIO_PROCESSING_NAMESPACE
@@ -0,0 +1,170 @@
+/**
+ * FixedRateAdapter
+ *
+ * Runs a ProcessorNode at a fixed internal sample rate, whatever rate the
+ * host runs at, by converting in and back out with SampleRateConverters.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "ProcessorNode.h"
+#include "SampleRateConverter.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * With a ratio that isn't a whole number, a host block doesn't turn into
+ * the same number of internal samples every time, and the converters hold
+ * back half their taps until they can compute an output.  So converted
+ * output goes into a FIFO that starts out holding getLatencySamples() of
+ * silence, and each host block takes exactly its own length back out of it.
+ * The converters don't delay the signal themselves, so that prefill is the
+ * whole latency.
+ *
+ * Converters, the internal buffer and the FIFO all come from the arena.
+ */
+class FixedRateAdapter : public ProcessorNode
+{
+public:
+
+    /**
+     * Construct.
+     *
+     * @param _pNode - the node to run; not owned, must outlive the adapter
+     * @param _internalRate - sample rate to run it at
+     * @param _quality - of both converters
+     */
+    FixedRateAdapter(
+        ProcessorNode * _pNode,
+        const double _internalRate,
+        const SampleRateConverter::Quality _quality = SampleRateConverter::qualityHigh
+    ):
+        pNode(_pNode),
+        internalRate(_internalRate),
+        converterIn(_quality),
+        converterOut(_quality)
+    {
+        jassert(pNode != nullptr);
+        jassert(internalRate > 0.0);
+    }
+
+    // Destruct
+    virtual ~FixedRateAdapter() = default;
+
+    // Prepare both converters and the node at the internal rate, and prefill the FIFO.
+    void prepare(
+        const double sampleRate,
+        const int _maxBlockSize,
+        const int _numChannels,
+        juce_igutil::AlignedArena & arena) override
+    {
+        maxBlockSize = _maxBlockSize;
+        numChannels = _numChannels;
+
+        converterIn.prepare(sampleRate, internalRate, numChannels, maxBlockSize, arena);
+        const int maxInternalSamples = converterIn.getMaxOutputSamples(maxBlockSize);
+        converterOut.prepare(internalRate, sampleRate, numChannels, maxInternalSamples, arena);
+        const int maxOutputSamples = converterOut.getMaxOutputSamples(maxInternalSamples);
+
+        SAMPLE_TYPE ** channels = nullptr;
+        arena.allocateChannels(channels, numChannels, (size_t) maxInternalSamples);
+        internal.setDataToReferTo(channels, numChannels, maxInternalSamples);
+
+        // Enough to cover what both converters hold back, in host samples, plus
+        // a sample of rounding for each.
+        fifoLatency = converterIn.getLookaheadSamples()
+            + (int) std::ceil(converterOut.getLookaheadSamples() * sampleRate / internalRate) + 2;
+        const int fifoSize = fifoLatency + maxOutputSamples + maxBlockSize;
+        arena.allocateChannels(channels, numChannels, (size_t) fifoSize);
+        fifo.setDataToReferTo(channels, numChannels, fifoSize);
+        fifo.clear();
+        numInFifo = fifoLatency;
+        numUnderruns = 0;
+
+        hostToInternal = internalRate / sampleRate;
+        pNode->prepare(internalRate, maxInternalSamples, numChannels, arena);
+    }
+
+    // Process any number of samples.  The output is delayed by getLatencySamples().
+    void process(
+        juce::AudioBuffer<SAMPLE_TYPE> & buffer,
+        int startSample,
+        int numSamples) override
+    {
+        while (numSamples > 0) {
+            const int numToProcess = juce::jmin(numSamples, maxBlockSize);
+            processChunk(buffer, startSample, numToProcess);
+            startSample += numToProcess;
+            numSamples -= numToProcess;
+        }
+    }
+
+    int getLatencySamples() const override
+    {
+        return fifoLatency + juce::roundToInt(pNode->getLatencySamples() / hostToInternal);
+    }
+
+    // Reset and clean up any resources.
+    void releaseResources() override
+    {
+        pNode->releaseResources();
+        converterIn.reset();
+        converterOut.reset();
+        fifo.clear();
+        numInFifo = fifoLatency;
+    }
+
+    inline double getInternalRate() const { return internalRate; }
+
+    // Blocks where the FIFO ran short and was padded with silence.  Should stay 0.
+    inline int getNumUnderruns() const { return numUnderruns; }
+
+private:
+
+    // Up to maxBlockSize samples:  convert in, process, convert out into the FIFO, take the block off the front.
+    void processChunk(juce::AudioBuffer<SAMPLE_TYPE> & buffer, const int startSample, const int numSamples)
+    {
+        const int numInternal = converterIn.process(buffer, startSample, numSamples, internal, 0);
+        pNode->process(internal, 0, numInternal);
+        numInFifo += converterOut.process(internal, 0, numInternal, fifo, numInFifo);
+
+        const int numChannelsToUse = juce::jmin(numChannels, buffer.getNumChannels());
+        const int numAvailable = juce::jmin(numSamples, numInFifo);
+        if (numAvailable < numSamples) ++numUnderruns;
+
+        for (int chan = 0; chan < numChannelsToUse; ++chan) {
+            SAMPLE_TYPE * pFifo = fifo.getWritePointer(chan);
+            buffer.copyFrom(chan, startSample, pFifo, numAvailable);
+            if (numAvailable < numSamples) {
+                buffer.clear(chan, startSample + numAvailable, numSamples - numAvailable);
+            }
+            std::memmove(pFifo, pFifo + numAvailable, sizeof(SAMPLE_TYPE) * (size_t) (numInFifo - numAvailable));
+        }
+        numInFifo -= numAvailable;
+    }
+
+    ProcessorNode * pNode;
+    const double internalRate;
+
+    SampleRateConverter converterIn;
+    SampleRateConverter converterOut;
+
+    int maxBlockSize = 0;
+    int numChannels = 0;
+    double hostToInternal = 1.0;
+
+    // Both refer to arena memory.
+    juce::AudioBuffer<SAMPLE_TYPE> internal;
+    juce::AudioBuffer<SAMPLE_TYPE> fifo;
+
+    int fifoLatency = 0;
+    int numInFifo = 0;
+    int numUnderruns = 0;
+};
+
+} // AUDIO_PROCESSING_NAMESPACE
@@ -0,0 +1,342 @@
+/**
+ * Oversampler
+ *
+ * Runs a ProcessorNode at 2x, 4x or 8x the sample rate, so that nonlinear
+ * stages don't alias.  Each factor of two is a half-band polyphase IIR
+ * filter:  two chains of first-order allpasses, one per phase.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <math.h>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "ProcessorNode.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * Up:  each input sample goes through both allpass chains, and the two
+ * outputs are the even and odd samples at the higher rate.  Down:  the odd
+ * and even samples go through one chain each and are averaged.  Both run at
+ * the lower rate of their stage, so a factor of two costs one chain per
+ * output sample.
+ *
+ * Channels are processed side by side, one per lane of a SIMDRegister of
+ * SAMPLE_TYPE, with the filter state in SAMPLE_TYPE.  The filters are
+ * designed in double for each precision:  the float version stops at
+ * about the float noise floor, the double version goes further and costs
+ * more coefficients.
+ *
+ * The allpass filters are minimum phase, not linear phase, so the delay
+ * depends on frequency and is only a few samples; it isn't reported as
+ * latency.  The wrapped node's latency is, converted to the host rate.
+ */
+class Oversampler : public ProcessorNode
+{
+public:
+
+    using Register = juce::dsp::SIMDRegister<SAMPLE_TYPE>;
+    static constexpr int numLanes = (int) Register::SIMDNumElements;
+
+    static const int maxNumStages = 3;
+
+    /**
+     * Construct.
+     *
+     * @param _pNode - the node to run at the higher rate; not owned, must outlive the oversampler
+     * @param _numStages - 1, 2 or 3, for 2x, 4x or 8x
+     */
+    Oversampler(ProcessorNode * _pNode, const int _numStages):
+        pNode(_pNode),
+        numStages(_numStages),
+        factor(1 << _numStages)
+    {
+        jassert(pNode != nullptr);
+        jassert(numStages >= 1 && numStages <= maxNumStages);
+    }
+
+    // Destruct
+    virtual ~Oversampler() = default;
+
+    // Design the filters, carve out state and buffers, and prepare the node at the higher rate.
+    void prepare(
+        const double sampleRate,
+        const int _maxBlockSize,
+        const int _numChannels,
+        juce_igutil::AlignedArena & arena) override
+    {
+        maxBlockSize = _maxBlockSize;
+        numChannels = _numChannels;
+        numGroups = (numChannels + numLanes - 1) / numLanes;
+
+        // The first stage up (and last down) has to keep the whole host band, right up
+        // to its Nyquist.  Later ones run where that band is a small fraction of the
+        // rate, so they get a much wider transition band and fewer coefficients.
+        const bool isDouble = sizeof(SAMPLE_TYPE) == sizeof(double);
+        const double attenuationDecibels = isDouble ? 140.0 : 100.0;
+        for (int stage = 0; stage < numStages; ++stage) {
+            const double transition = stage == 0 ? 0.04 : 0.2;
+            numCoefficients[stage] = designHalfBand(coefficients[stage], attenuationDecibels, transition);
+        }
+
+        // state:  [group][stage][up / down][x / y][coefficient][lane]
+        const int stateSize = numGroups * numStages * 2 * 2 * maxNumCoefficients * numLanes;
+        arena.allocate(pState, (size_t) stateSize);
+
+        // interleaved ping-pong buffers for one group, and the planar buffer the node sees
+        arena.allocate(pInterleavedA, (size_t) (maxBlockSize * factor * numLanes));
+        arena.allocate(pInterleavedB, (size_t) (maxBlockSize * factor * numLanes));
+        SAMPLE_TYPE ** channels = nullptr;
+        arena.allocateChannels(channels, numChannels, (size_t) (maxBlockSize * factor));
+        oversampled.setDataToReferTo(channels, numChannels, maxBlockSize * factor);
+
+        pNode->prepare(sampleRate * factor, maxBlockSize * factor, numChannels, arena);
+    }
+
+    // Process at the higher rate, in place.
+    void process(
+        juce::AudioBuffer<SAMPLE_TYPE> & buffer,
+        int startSample,
+        int numSamples) override
+    {
+        while (numSamples > 0) {
+            const int numToProcess = juce::jmin(numSamples, maxBlockSize);
+            processChunk(buffer, startSample, numToProcess);
+            startSample += numToProcess;
+            numSamples -= numToProcess;
+        }
+    }
+
+    int getLatencySamples() const override
+    {
+        return (pNode->getLatencySamples() + factor / 2) / factor;
+    }
+
+    // Clear the filter state.
+    void releaseResources() override
+    {
+        pNode->releaseResources();
+        if (pState != nullptr) {
+            juce::FloatVectorOperations::clear(pState, numGroups * numStages * 2 * 2 * maxNumCoefficients * numLanes);
+        }
+    }
+
+    inline int getFactor() const { return factor; }
+
+private:
+
+    static const int maxNumCoefficients = 16;
+
+    enum Direction { directionUp = 0, directionDown };
+
+    /**
+     * Half-band polyphase IIR design, after Laurent de Soras' HIIR.  Works
+     * out the order needed for the given stopband attenuation and transition
+     * band (a fraction of the stage's higher rate), then the allpass
+     * coefficients.  Always in double.
+     *
+     * @return the number of coefficients
+     */
+    static int designHalfBand(SAMPLE_TYPE * pCoefficients, const double attenuationDecibels, const double transition)
+    {
+        const double pi = juce::MathConstants<double>::pi;
+
+        double k = std::tan((1.0 - transition * 2.0) * pi / 4.0);
+        k *= k;
+        const double kksqrt = std::pow(1.0 - k * k, 0.25);
+        const double e = 0.5 * (1.0 - kksqrt) / (1.0 + kksqrt);
+        const double e4 = e * e * e * e;
+        const double q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+
+        const double attenuation = std::pow(10.0, -attenuationDecibels / 10.0);
+        const double a = attenuation / (1.0 - attenuation);
+        int order = (int) std::ceil(std::log(a * a / 16.0) / std::log(q));
+        if ((order & 1) == 0) ++order;
+        if (order < 3) order = 3;
+
+        const int numCoefficients = juce::jmin((order - 1) / 2, maxNumCoefficients);
+        order = numCoefficients * 2 + 1;
+
+        for (int index = 0; index < numCoefficients; ++index) {
+            const int c = index + 1;
+
+            // the two theta-function series, summed until the terms vanish
+            double numerator = 0.0;
+            double term = 0.0;
+            int i = 0;
+            do {
+                term = std::pow(q, (double) (i * (i + 1))) * std::sin((i * 2 + 1) * c * pi / order) * ((i & 1) ? -1.0 : 1.0);
+                numerator += term;
+                ++i;
+            } while (std::abs(term) > 1e-100);
+
+            double denominator = 0.0;
+            i = 1;
+            do {
+                term = std::pow(q, (double) (i * i)) * std::cos(i * 2 * c * pi / order) * ((i & 1) ? -1.0 : 1.0);
+                denominator += term;
+                ++i;
+            } while (std::abs(term) > 1e-100);
+
+            const double ww = numerator * std::pow(q, 0.25) / (denominator + 0.5);
+            const double wwsq = ww * ww;
+            const double x = std::sqrt((1.0 - wwsq * k) * (1.0 - wwsq / k)) / (1.0 + wwsq);
+            pCoefficients[index] = (SAMPLE_TYPE) ((1.0 - x) / (1.0 + x));
+        }
+
+        return numCoefficients;
+    }
+
+    // Start of the state for one filter.
+    inline SAMPLE_TYPE * getState(const int group, const int stage, const Direction direction)
+    {
+        return pState + ((group * numStages + stage) * 2 + direction) * 2 * maxNumCoefficients * numLanes;
+    }
+
+    // Up, through the node, and down again.
+    void processChunk(juce::AudioBuffer<SAMPLE_TYPE> & buffer, const int startSample, const int numSamples)
+    {
+        const int numChannelsToUse = juce::jmin(numChannels, buffer.getNumChannels());
+        const int numOversampled = numSamples * factor;
+
+        for (int group = 0; group < numGroups; ++group) {
+            interleave(buffer, startSample, numSamples, group, numChannelsToUse, pInterleavedA);
+            SAMPLE_TYPE * pIn = pInterleavedA;
+            SAMPLE_TYPE * pOut = pInterleavedB;
+            for (int stage = 0, n = numSamples; stage < numStages; ++stage, n *= 2) {
+                upsampleStage(pIn, pOut, n, stage, getState(group, stage, directionUp));
+                std::swap(pIn, pOut);
+            }
+            deinterleave(pIn, oversampled, 0, numOversampled, group, numChannelsToUse);
+        }
+
+        pNode->process(oversampled, 0, numOversampled);
+
+        for (int group = 0; group < numGroups; ++group) {
+            interleave(oversampled, 0, numOversampled, group, numChannelsToUse, pInterleavedA);
+            SAMPLE_TYPE * pIn = pInterleavedA;
+            SAMPLE_TYPE * pOut = pInterleavedB;
+            for (int stage = numStages - 1, n = numOversampled / 2; stage >= 0; --stage, n /= 2) {
+                downsampleStage(pIn, pOut, n, stage, getState(group, stage, directionDown));
+                std::swap(pIn, pOut);
+            }
+            deinterleave(pIn, buffer, startSample, numSamples, group, numChannelsToUse);
+        }
+    }
+
+    // Channels of one group into [sample][lane]; lanes with no channel get zeros.
+    void interleave(const juce::AudioBuffer<SAMPLE_TYPE> & source, const int startSample, const int numSamples,
+        const int group, const int numChannelsToUse, SAMPLE_TYPE * pDest) const
+    {
+        for (int lane = 0; lane < numLanes; ++lane) {
+            const int chan = group * numLanes + lane;
+            if (chan < numChannelsToUse) {
+                const SAMPLE_TYPE * pSource = source.getReadPointer(chan, startSample);
+                for (int n = 0; n < numSamples; ++n) pDest[n * numLanes + lane] = pSource[n];
+            }
+            else {
+                for (int n = 0; n < numSamples; ++n) pDest[n * numLanes + lane] = 0;
+            }
+        }
+    }
+
+    // And back again.
+    void deinterleave(const SAMPLE_TYPE * pSource, juce::AudioBuffer<SAMPLE_TYPE> & dest, const int startSample,
+        const int numSamples, const int group, const int numChannelsToUse) const
+    {
+        for (int lane = 0; lane < numLanes; ++lane) {
+            const int chan = group * numLanes + lane;
+            if (chan >= numChannelsToUse) break;
+            SAMPLE_TYPE * pDest = dest.getWritePointer(chan, startSample);
+            for (int n = 0; n < numSamples; ++n) pDest[n] = pSource[n * numLanes + lane];
+        }
+    }
+
+    // numSamples interleaved frames in, twice as many out.  Even coefficients make the even phase, odd the odd.
+    void upsampleStage(const SAMPLE_TYPE * pIn, SAMPLE_TYPE * pOut, const int numSamples, const int stage, SAMPLE_TYPE * pStageState)
+    {
+        const int numCoefs = numCoefficients[stage];
+        Register coef[maxNumCoefficients], memX[maxNumCoefficients], memY[maxNumCoefficients];
+        loadState(stage, pStageState, coef, memX, memY);
+
+        for (int n = 0; n < numSamples; ++n) {
+            const Register x = Register::fromRawArray(pIn + n * numLanes);
+            Register even = x, odd = x;
+            for (int c = 0; c < numCoefs; c += 2) even = allpass(even, coef[c], memX[c], memY[c]);
+            for (int c = 1; c < numCoefs; c += 2) odd = allpass(odd, coef[c], memX[c], memY[c]);
+            even.copyToRawArray(pOut + (2 * n) * numLanes);
+            odd.copyToRawArray(pOut + (2 * n + 1) * numLanes);
+        }
+
+        storeState(stage, pStageState, memX, memY);
+    }
+
+    // numSamples * 2 interleaved frames in, numSamples out.
+    void downsampleStage(const SAMPLE_TYPE * pIn, SAMPLE_TYPE * pOut, const int numSamples, const int stage, SAMPLE_TYPE * pStageState)
+    {
+        const int numCoefs = numCoefficients[stage];
+        Register coef[maxNumCoefficients], memX[maxNumCoefficients], memY[maxNumCoefficients];
+        loadState(stage, pStageState, coef, memX, memY);
+        const Register half = Register::expand((SAMPLE_TYPE) 0.5);
+
+        for (int n = 0; n < numSamples; ++n) {
+            Register even = Register::fromRawArray(pIn + (2 * n + 1) * numLanes);
+            Register odd = Register::fromRawArray(pIn + (2 * n) * numLanes);
+            for (int c = 0; c < numCoefs; c += 2) even = allpass(even, coef[c], memX[c], memY[c]);
+            for (int c = 1; c < numCoefs; c += 2) odd = allpass(odd, coef[c], memX[c], memY[c]);
+            ((even + odd) * half).copyToRawArray(pOut + n * numLanes);
+        }
+
+        storeState(stage, pStageState, memX, memY);
+    }
+
+    // First-order allpass in z^-2, at the lower rate:  y = (x - y[-1]) * c + x[-1]
+    static inline Register allpass(const Register x, const Register coef, Register & memX, Register & memY)
+    {
+        const Register y = (x - memY) * coef + memX;
+        memX = x;
+        memY = y;
+        return y;
+    }
+
+    void loadState(const int stage, const SAMPLE_TYPE * pStageState, Register * coef, Register * memX, Register * memY) const
+    {
+        for (int c = 0; c < numCoefficients[stage]; ++c) {
+            coef[c] = Register::expand(coefficients[stage][c]);
+            memX[c] = Register::fromRawArray(pStageState + c * numLanes);
+            memY[c] = Register::fromRawArray(pStageState + (maxNumCoefficients + c) * numLanes);
+        }
+    }
+
+    void storeState(const int stage, SAMPLE_TYPE * pStageState, const Register * memX, const Register * memY) const
+    {
+        for (int c = 0; c < numCoefficients[stage]; ++c) {
+            memX[c].copyToRawArray(pStageState + c * numLanes);
+            memY[c].copyToRawArray(pStageState + (maxNumCoefficients + c) * numLanes);
+        }
+    }
+
+    ProcessorNode * pNode;
+    const int numStages;
+    const int factor;
+
+    int maxBlockSize = 0;
+    int numChannels = 0;
+    int numGroups = 0;
+
+    // per stage, stage 0 being the one next to the host rate
+    SAMPLE_TYPE coefficients[maxNumStages][maxNumCoefficients] = {};
+    int numCoefficients[maxNumStages] = {};
+
+    // All of these refer to arena memory.
+    SAMPLE_TYPE * pState = nullptr;
+    SAMPLE_TYPE * pInterleavedA = nullptr;
+    SAMPLE_TYPE * pInterleavedB = nullptr;
+    juce::AudioBuffer<SAMPLE_TYPE> oversampled;
+};
+
+} // AUDIO_PROCESSING_NAMESPACE
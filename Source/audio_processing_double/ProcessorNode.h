@@ -0,0 +1,65 @@
+/**
+ * ProcessorNode
+ *
+ * Common interface for audio-processing objects that can be chained,
+ * wrapped (e.g. by the FixedBlockAdapter) and swapped at run time.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "../juce_igutil/AlignedArena.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * A node processes an AudioBuffer of the concrete SAMPLE_TYPE in place.
+ * Because the buffer type is concrete, this can be a plain virtual
+ * interface.
+ */
+class ProcessorNode
+{
+public:
+
+    // Destruct
+    virtual ~ProcessorNode() = default;
+
+    /**
+     * Prepare to start playing.  Not real-time safe.  Any memory the node
+     * needs while processing must come from the arena, so that process()
+     * never allocates.
+     */
+    virtual void prepare(
+        const double sampleRate,
+        const int maxBlockSize,
+        const int numChannels,
+        juce_igutil::AlignedArena & arena) = 0;
+
+    // Process numSamples samples of the buffer in place, starting at startSample.
+    virtual void process(
+        juce::AudioBuffer<SAMPLE_TYPE> & buffer,
+        int startSample,
+        int numSamples) = 0;
+
+    // Latency this node adds, in samples.
+    virtual int getLatencySamples() const { return 0; }
+
+    /**
+     * State that has to carry over when processing moves between this node
+     * and its counterpart in the other precision - oscillator phases,
+     * filter memories - held as doubles so either precision can read it.
+     * Nodes without any keep the defaults.  Real-time safe.
+     */
+    virtual int getNumStateValues() const { return 0; }
+    virtual void saveState(double * pState) const {}
+    virtual void loadState(const double * pState) {}
+
+    // Reset and clean up any resources.
+    virtual void releaseResources() {}
+};
+
+} // AUDIO_PROCESSING_NAMESPACE
@@ -1,20 +1,18 @@
 // WARNING: Only include this file in audio-processing code inside of this directory!
 
-// this guard should be more failsafe than #pragma once.
-#ifndef __audio_processing_header_double_h__
-#define __audio_processing_header_double_h__
-
-
+// There is deliberately no include guard.  Both precisions use the same macro
+// names, so they have to be reset on every include; otherwise a header from this
+// directory included after one from the other precision's directory would pick up
+// the wrong SAMPLE_TYPE and namespace.  Every header in this directory must include
+// this file before using them.
 
 // FP number precision for samples
+#undef SAMPLE_TYPE
 #define SAMPLE_TYPE  double
 
 // Name of the namespace for this processing type.  All classes in this folder
 // should be inside this namespace.
+#undef AUDIO_PROCESSING_NAMESPACE
 #define AUDIO_PROCESSING_NAMESPACE  audio_processing_double
 
 
-
-
-#endif // __audio_processing_header_double_h__
-
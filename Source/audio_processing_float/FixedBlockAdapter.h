@@ -0,0 +1,129 @@
+/**
+ * FixedBlockAdapter
+ *
+ * Runs a ProcessorNode at a fixed internal block size, whatever size of
+ * block the host hands over.  Some hosts deliver irregular slices of a few
+ * samples, and the per-call overhead then swamps the actual processing.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "ProcessorNode.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * Host samples are queued into an input block; once it is full, the wrapped
+ * node processes it in one call and it becomes the output block, which is
+ * read out while the next input block fills.  Both blocks live in the arena
+ * and are swapped by pointer, so there's no locking, no allocation and no
+ * extra copying beyond the one in and one out.
+ *
+ * The price is exactly one internal block of latency, which the owner must
+ * report to the host (setLatencySamples()).
+ */
+class FixedBlockAdapter : public ProcessorNode
+{
+public:
+
+    /**
+     * Construct.
+     *
+     * @param _pNode - the node to run; not owned, must outlive the adapter
+     * @param _blockSize - internal block size, a power of two
+     */
+    FixedBlockAdapter(ProcessorNode * _pNode, const int _blockSize):
+        pNode(_pNode),
+        blockSize(_blockSize)
+    {
+        jassert(pNode != nullptr);
+        jassert(juce::isPowerOfTwo(blockSize));
+    }
+
+    // Destruct
+    virtual ~FixedBlockAdapter() = default;
+
+    // Prepare the wrapped node for the internal block size and carve out both blocks.
+    void prepare(
+        const double sampleRate,
+        const int maxBlockSize,
+        const int _numChannels,
+        juce_igutil::AlignedArena & arena) override
+    {
+        numChannels = _numChannels;
+
+        SAMPLE_TYPE ** channels = nullptr;
+        arena.allocateChannels(channels, numChannels, blockSize);
+        inBlock.setDataToReferTo(channels, numChannels, blockSize);
+        arena.allocateChannels(channels, numChannels, blockSize);
+        outBlock.setDataToReferTo(channels, numChannels, blockSize);
+        position = 0;
+
+        pNode->prepare(sampleRate, blockSize, numChannels, arena);
+    }
+
+    // Process any number of samples.  The output is delayed by getLatencySamples().
+    void process(
+        juce::AudioBuffer<SAMPLE_TYPE> & buffer,
+        int startSample,
+        int numSamples) override
+    {
+        const int numChannelsToUse = juce::jmin(numChannels, buffer.getNumChannels());
+
+        while (numSamples > 0) {
+            const int numToCopy = juce::jmin(numSamples, blockSize - position);
+
+            for (int chan = 0; chan < numChannelsToUse; ++chan) {
+                SAMPLE_TYPE * pHost = buffer.getWritePointer(chan, startSample);
+                juce::FloatVectorOperations::copy(inBlock.getWritePointer(chan, position), pHost, numToCopy);
+                juce::FloatVectorOperations::copy(pHost, outBlock.getReadPointer(chan, position), numToCopy);
+            }
+
+            startSample += numToCopy;
+            numSamples -= numToCopy;
+            position += numToCopy;
+
+            // Input block full:  it becomes the output block and is processed in one go.
+            if (position == blockSize) {
+                std::swap(inBlock, outBlock);
+                pNode->process(outBlock, 0, blockSize);
+                position = 0;
+            }
+        }
+    }
+
+    int getLatencySamples() const override
+    {
+        return blockSize + pNode->getLatencySamples();
+    }
+
+    inline int getBlockSize() const { return blockSize; }
+
+    // Reset and clean up any resources.
+    void releaseResources() override
+    {
+        pNode->releaseResources();
+        position = 0;
+    }
+
+private:
+
+    ProcessorNode * pNode;
+    const int blockSize;
+
+    int numChannels = 0;
+
+    // Both refer to arena memory.  Swapping them only swaps the pointers.
+    juce::AudioBuffer<SAMPLE_TYPE> inBlock;
+    juce::AudioBuffer<SAMPLE_TYPE> outBlock;
+
+    // how far into the current pair of blocks we are
+    int position = 0;
+};
+
+} // AUDIO_PROCESSING_NAMESPACE
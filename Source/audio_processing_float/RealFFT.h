@@ -0,0 +1,202 @@
+/**
+ * RealFFT
+ *
+ * Forward and inverse FFT of real signals, in SAMPLE_TYPE.  juce::dsp::FFT
+ * only does float, so this is what lets the double version stay double
+ * all the way through.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <math.h>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "../juce_igutil/AlignedArena.h"
+#include "../juce_igutil/TableCache.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * A size-N real transform done as a size-N/2 complex radix-2 transform
+ * plus a split step.  Spectra are N/2 + 1 bins, with real and imaginary
+ * parts in separate arrays, so multiplying spectra vectorises.  Twiddles are
+ * shared through the TableCache with every transform of the same size and
+ * precision; scratch comes from the arena.  Nothing allocates after prepare().
+ *
+ * Not thread safe:  one instance per thread.
+ */
+class RealFFT
+{
+public:
+
+    RealFFT() = default;
+
+    // Destruct
+    virtual ~RealFFT() = default;
+
+    /**
+     * Set the size and build the tables.  Not real-time safe.
+     *
+     * @param _size - transform size, a power of two, at least 4
+     * @param arena - where the scratch goes
+     */
+    void prepare(const int _size, juce_igutil::AlignedArena & arena)
+    {
+        jassert(juce::isPowerOfTwo(_size) && _size >= 4);
+        size = _size;
+        halfSize = size / 2;
+
+        arena.allocate(pScratch, (size_t) size);
+        pBitReverse = static_cast<int *>(arena.allocateBytes(sizeof(int) * (size_t) halfSize));
+
+        // complex transform twiddles e^(-2 pi i k / halfSize), and split twiddles
+        // e^(-2 pi i k / size), one after the other
+        const int tableSize = size, tableHalfSize = halfSize;
+        pTwiddleTable = juce_igutil::TableCache::getInstance().acquire(
+            "RealFFT twiddles",
+            (size_t) (4 * halfSize),
+            sizeof(SAMPLE_TYPE) == sizeof(double),
+            [=](double * pDest, size_t) {
+                for (int k = 0; k < tableHalfSize; ++k) {
+                    const double complexAngle = -juce::MathConstants<double>::twoPi * k / tableHalfSize;
+                    const double splitAngle = -juce::MathConstants<double>::twoPi * k / tableSize;
+                    pDest[k] = std::cos(complexAngle);
+                    pDest[tableHalfSize + k] = std::sin(complexAngle);
+                    pDest[2 * tableHalfSize + k] = std::cos(splitAngle);
+                    pDest[3 * tableHalfSize + k] = std::sin(splitAngle);
+                }
+            });
+
+        int numBits = 0;
+        while ((1 << numBits) < halfSize) ++numBits;
+        for (int i = 0; i < halfSize; ++i) {
+            int reversed = 0;
+            for (int bit = 0; bit < numBits; ++bit) {
+                if (i & (1 << bit)) reversed |= 1 << (numBits - 1 - bit);
+            }
+            pBitReverse[i] = reversed;
+        }
+
+        const SAMPLE_TYPE * pTwiddles = nullptr;
+        pTwiddleTable->waitUntilReady();
+        pTwiddleTable->getData(pTwiddles);
+        pTwiddleRe = pTwiddles;
+        pTwiddleIm = pTwiddles + halfSize;
+        pSplitRe = pTwiddles + 2 * halfSize;
+        pSplitIm = pTwiddles + 3 * halfSize;
+    }
+
+    inline int getSize() const { return size; }
+    inline int getNumBins() const { return halfSize + 1; }
+
+    /**
+     * Forward transform, unscaled.
+     *
+     * @param pIn - size samples
+     * @param pRe - getNumBins() real parts out
+     * @param pIm - getNumBins() imaginary parts out
+     */
+    void forward(const SAMPLE_TYPE * pIn, SAMPLE_TYPE * pRe, SAMPLE_TYPE * pIm)
+    {
+        // even samples as the real parts, odd as the imaginary
+        juce::FloatVectorOperations::copy(pScratch, pIn, size);
+        complexTransform(false);
+
+        pRe[0] = pScratch[0] + pScratch[1];
+        pIm[0] = 0;
+        pRe[halfSize] = pScratch[0] - pScratch[1];
+        pIm[halfSize] = 0;
+
+        for (int k = 1; k < halfSize; ++k) {
+            const SAMPLE_TYPE a = pScratch[2 * k], b = pScratch[2 * k + 1];
+            const SAMPLE_TYPE c = pScratch[2 * (halfSize - k)], d = pScratch[2 * (halfSize - k) + 1];
+
+            // even and odd sample spectra
+            const SAMPLE_TYPE evenRe = (a + c) / 2, evenIm = (b - d) / 2;
+            const SAMPLE_TYPE oddRe = (b + d) / 2, oddIm = (c - a) / 2;
+
+            pRe[k] = evenRe + pSplitRe[k] * oddRe - pSplitIm[k] * oddIm;
+            pIm[k] = evenIm + pSplitRe[k] * oddIm + pSplitIm[k] * oddRe;
+        }
+    }
+
+    /**
+     * Inverse transform, scaled so that inverse(forward(x)) == x.
+     *
+     * @param pRe - getNumBins() real parts
+     * @param pIm - getNumBins() imaginary parts
+     * @param pOut - size samples out
+     */
+    void inverse(const SAMPLE_TYPE * pRe, const SAMPLE_TYPE * pIm, SAMPLE_TYPE * pOut)
+    {
+        for (int k = 0; k < halfSize; ++k) {
+            const SAMPLE_TYPE a = pRe[k], b = pIm[k];
+            const SAMPLE_TYPE c = pRe[halfSize - k], d = pIm[halfSize - k];
+
+            const SAMPLE_TYPE evenRe = (a + c) / 2, evenIm = (b - d) / 2;
+            const SAMPLE_TYPE diffRe = (a - c) / 2, diffIm = (b + d) / 2;
+
+            // odd spectrum = difference * conj(split twiddle)
+            const SAMPLE_TYPE oddRe = diffRe * pSplitRe[k] + diffIm * pSplitIm[k];
+            const SAMPLE_TYPE oddIm = diffIm * pSplitRe[k] - diffRe * pSplitIm[k];
+
+            pScratch[2 * k] = evenRe - oddIm;
+            pScratch[2 * k + 1] = evenIm + oddRe;
+        }
+
+        complexTransform(true);
+        juce::FloatVectorOperations::multiply(pOut, pScratch, (SAMPLE_TYPE) 1 / halfSize, size);
+    }
+
+private:
+
+    // In-place, unscaled radix-2 transform of the halfSize interleaved complex values in pScratch.
+    void complexTransform(const bool isInverse)
+    {
+        for (int i = 0; i < halfSize; ++i) {
+            const int j = pBitReverse[i];
+            if (i < j) {
+                std::swap(pScratch[2 * i], pScratch[2 * j]);
+                std::swap(pScratch[2 * i + 1], pScratch[2 * j + 1]);
+            }
+        }
+
+        for (int length = 2; length <= halfSize; length *= 2) {
+            const int half = length / 2;
+            const int step = halfSize / length;
+            for (int start = 0; start < halfSize; start += length) {
+                for (int k = 0; k < half; ++k) {
+                    const SAMPLE_TYPE wRe = pTwiddleRe[k * step];
+                    const SAMPLE_TYPE wIm = isInverse ? -pTwiddleIm[k * step] : pTwiddleIm[k * step];
+                    SAMPLE_TYPE * pA = pScratch + 2 * (start + k);
+                    SAMPLE_TYPE * pB = pA + 2 * half;
+                    const SAMPLE_TYPE tRe = wRe * pB[0] - wIm * pB[1];
+                    const SAMPLE_TYPE tIm = wRe * pB[1] + wIm * pB[0];
+                    pB[0] = pA[0] - tRe;
+                    pB[1] = pA[1] - tIm;
+                    pA[0] += tRe;
+                    pA[1] += tIm;
+                }
+            }
+        }
+    }
+
+    int size = 0;
+    int halfSize = 0;
+
+    // Shared twiddle table, and pointers into it
+    std::shared_ptr<const juce_igutil::TableCache::Table> pTwiddleTable;
+    const SAMPLE_TYPE * pTwiddleRe = nullptr;
+    const SAMPLE_TYPE * pTwiddleIm = nullptr;
+    const SAMPLE_TYPE * pSplitRe = nullptr;
+    const SAMPLE_TYPE * pSplitIm = nullptr;
+
+    // Both refer to arena memory.
+    SAMPLE_TYPE * pScratch = nullptr;       // halfSize interleaved complex values
+    int * pBitReverse = nullptr;
+};
+
+} // AUDIO_PROCESSING_NAMESPACE
@@ -0,0 +1,220 @@
+/**
+ * SampleGuard
+ *
+ * Scans audio buffers for denormals and NaN/Inf, counting them per
+ * processing stage and per channel, and optionally flushing them to zero.
+ * Counts are logged periodically through the MTLogger.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "../juce_igutil/MTLogger.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * The scan works on the raw bit patterns rather than comparing values.
+ * That matters because processBlock() runs under ScopedNoDenormals:  with
+ * denormals-are-zero set, a denormal compares equal to 0 and would never be
+ * counted.  Integer masks are also what lets the compiler vectorise the
+ * loops (there are no branches in them).
+ */
+class SampleGuard
+{
+public:
+
+    static const int maxStages = 8;
+    static const int maxChannels = 8;
+
+    // Construct.  Counts are logged every logIntervalBlocks calls to endBlock(), if any were found.
+    SampleGuard( std::shared_ptr<juce_igutil::MTLogger> _pMTL, const int _logIntervalBlocks = 1000 ) :
+        pMTL(_pMTL),
+        logIntervalBlocks(_logIntervalBlocks)
+    {
+        for (int stage = 0; stage < maxStages; ++stage)
+            stageNames[stage] = juce::String("stage ") + juce::String(stage);
+    }
+
+    // Destruct
+    virtual ~SampleGuard() = default;
+
+    // Name a stage for the log.  Not real-time safe; call at setup.
+    void setStageName(const int stage, const juce::String& name)
+    {
+        jassert(stage >= 0 && stage < maxStages);
+        stageNames[stage] = name;
+    }
+
+    // Turn scanning on or off.  When off, check() does nothing.
+    inline void setEnabled(const bool shouldBeEnabled) { enabled = shouldBeEnabled; }
+    inline bool isEnabled() const { return enabled; }
+
+    // Flush anything found to zero.
+    inline void setSanitising(const bool shouldSanitise) { sanitising = shouldSanitise; }
+    inline bool isSanitising() const { return sanitising; }
+
+    /**
+     * Scan (and maybe sanitise) part of a buffer, counting towards the
+     * given stage.  Real-time safe.
+     *
+     * @return true if anything was found.
+     */
+    bool check(
+        juce::AudioBuffer<SAMPLE_TYPE> & buffer,
+        const int startSample,
+        const int numSamples,
+        const int stage)
+    {
+        if ( !enabled ) return false;
+        jassert(stage >= 0 && stage < maxStages);
+
+        bool found = false;
+        const int numChannels = juce::jmin(buffer.getNumChannels(), maxChannels);
+        for (int chan = 0; chan < numChannels; ++chan)
+        {
+            SAMPLE_TYPE* pSamples = buffer.getWritePointer(chan, startSample);
+
+            int numDenormals = 0;
+            int numNonFinite = 0;
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const SampleBits bits = toBits(pSamples[i]);
+                numDenormals += isDenormal(bits);
+                numNonFinite += isNonFinite(bits);
+            }
+
+            if (numDenormals + numNonFinite > 0)
+            {
+                found = true;
+                Counts& counts = stageCounts[stage][chan];
+                counts.denormals += numDenormals;
+                counts.nonFinite += numNonFinite;
+                pendingLog = true;
+
+                if (sanitising)
+                    sanitise(pSamples, numSamples);
+            }
+        }
+        return found;
+    }
+
+    /**
+     * Call once at the end of each block.  Logs the totals every
+     * logIntervalBlocks blocks if anything new was found.
+     */
+    void endBlock()
+    {
+        if (++blocksSinceLog < logIntervalBlocks) return;
+        blocksSinceLog = 0;
+
+        if ( !pendingLog ) return;
+        pendingLog = false;
+
+        for (int stage = 0; stage < maxStages; ++stage)
+        {
+            juce::String message;
+            for (int chan = 0; chan < maxChannels; ++chan)
+            {
+                const Counts& counts = stageCounts[stage][chan];
+                if (counts.denormals + counts.nonFinite > 0)
+                    message += juce::String("  ch") + juce::String(chan) +
+                        juce::String(": denormals=") + juce::String(counts.denormals) +
+                        juce::String(", nonFinite=") + juce::String(counts.nonFinite);
+            }
+            if (message.isNotEmpty())
+                pMTL->warning(juce::String("SampleGuard totals for ") + stageNames[stage] + juce::String(":") + message);
+        }
+    }
+
+    // Totals over all channels since the last reset.
+    juce::uint64 getTotalDenormals() const { return sumCounts(true); }
+    juce::uint64 getTotalNonFinite() const { return sumCounts(false); }
+
+    // Totals for one stage and channel since the last reset.
+    juce::uint64 getDenormals(const int stage, const int chan) const { return stageCounts[stage][chan].denormals; }
+    juce::uint64 getNonFinite(const int stage, const int chan) const { return stageCounts[stage][chan].nonFinite; }
+
+    // Clear all counts.
+    void reset()
+    {
+        for (auto& stage : stageCounts)
+            for (auto& counts : stage)
+                counts = Counts();
+        blocksSinceLog = 0;
+        pendingLog = false;
+    }
+
+private:
+
+    // Unsigned integer the same size as SAMPLE_TYPE, and the IEEE-754 masks for it.
+    using SampleBits = std::conditional<sizeof(SAMPLE_TYPE) == 8, juce::uint64, juce::uint32>::type;
+    static constexpr int numMantissaBits = std::numeric_limits<SAMPLE_TYPE>::digits - 1;
+    static constexpr SampleBits mantissaMask = (SampleBits(1) << numMantissaBits) - 1;
+    static constexpr SampleBits exponentMask = ((SampleBits(1) << (sizeof(SampleBits) * 8 - 1)) - 1) & ~mantissaMask;
+
+    static inline SampleBits toBits(const SAMPLE_TYPE sample)
+    {
+        SampleBits bits;
+        std::memcpy(&bits, &sample, sizeof(bits));
+        return bits;
+    }
+
+    // zero exponent, non-zero mantissa
+    static inline int isDenormal(const SampleBits bits)
+    {
+        return ((bits & exponentMask) == 0) & ((bits & mantissaMask) != 0);
+    }
+
+    // all-ones exponent:  Inf or NaN
+    static inline int isNonFinite(const SampleBits bits)
+    {
+        return (bits & exponentMask) == exponentMask;
+    }
+
+    // Second pass, only taken when something was found.
+    static void sanitise(SAMPLE_TYPE* pSamples, const int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const SampleBits bits = toBits(pSamples[i]);
+            const bool bad = isDenormal(bits) | isNonFinite(bits);
+            pSamples[i] = bad ? static_cast<SAMPLE_TYPE>(0.0) : pSamples[i];
+        }
+    }
+
+    juce::uint64 sumCounts(const bool denormals) const
+    {
+        juce::uint64 total = 0;
+        for (const auto& stage : stageCounts)
+            for (const auto& counts : stage)
+                total += denormals ? counts.denormals : counts.nonFinite;
+        return total;
+    }
+
+    struct Counts {
+        juce::uint64 denormals = 0;
+        juce::uint64 nonFinite = 0;
+    };
+
+    std::shared_ptr<juce_igutil::MTLogger> pMTL;
+
+    Counts stageCounts[maxStages][maxChannels];
+    juce::String stageNames[maxStages];
+
+    const int logIntervalBlocks;
+    int blocksSinceLog = 0;
+    bool pendingLog = false;
+
+    bool enabled = true;
+    bool sanitising = false;
+};
+
+} // AUDIO_PROCESSING_NAMESPACE
@@ -0,0 +1,284 @@
+/**
+ * SampleRateConverter
+ *
+ * Streaming sample-rate conversion by any ratio:  windowed-sinc
+ * interpolation from a polyphase table, with quality presets trading taps
+ * for throughput.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <math.h>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "../juce_igutil/AlignedArena.h"
+#include "../juce_igutil/TableCache.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * Each output sample is a dot product of the input around its position
+ * with the Kaiser-windowed sinc kernel for that fractional position.  The
+ * kernel is tabulated for numPhases positions between two input samples and
+ * interpolated linearly between the two nearest.  When converting down, the
+ * cutoff follows the output rate, so there's no aliasing.
+ *
+ * The kernel is symmetric around the output position, so there is no delay
+ * in the signal; the converter just holds back half the taps of input until
+ * it has enough to compute each output.  The first output lines up with
+ * the first input.
+ *
+ * The kernel table is shared through the TableCache with every converter
+ * of the same quality, ratio and precision.  The input history comes from
+ * the arena; process() doesn't allocate.
+ */
+class SampleRateConverter
+{
+public:
+
+    // Roughly 50, 70, 95 and 120 dB of stopband attenuation.
+    enum Quality { qualityDraft = 0, qualityNormal, qualityHigh, qualityBest };
+
+    // Construct
+    SampleRateConverter(const Quality _quality = qualityHigh):
+        quality(_quality)
+    {
+        // empty
+    }
+
+    // Destruct
+    virtual ~SampleRateConverter() = default;
+
+    /**
+     * Get the kernel table and carve out the history.  Not real-time safe.
+     *
+     * @param _inputRate - sample rate of what goes in
+     * @param _outputRate - sample rate of what comes out
+     * @param _numChannels - number of channels
+     * @param _maxInputSamples - most input samples per process() call
+     * @param arena - where the history goes
+     */
+    void prepare(
+        const double _inputRate,
+        const double _outputRate,
+        const int _numChannels,
+        const int _maxInputSamples,
+        juce_igutil::AlignedArena & arena)
+    {
+        inputRate = _inputRate;
+        outputRate = _outputRate;
+        numChannels = _numChannels;
+        maxInputSamples = _maxInputSamples;
+        step = inputRate / outputRate;
+
+        //                           taps, phases, Kaiser beta, bandwidth (fraction of the lower Nyquist)
+        static const Preset presets[] = { {  16,  64,  4.55, 0.80 },
+                                          {  32, 128,  6.76, 0.87 },
+                                          {  64, 256,  9.51, 0.91 },
+                                          { 128, 512, 12.27, 0.94 } };
+        const Preset & preset = presets[quality];
+
+        // Converting down, the kernel stretches with the ratio, so the transition
+        // band stays the same fraction of the output rate.
+        numTaps = preset.numTaps * (int) std::ceil(juce::jmax(1.0, step));
+        halfTaps = numTaps / 2;
+        numPhases = preset.numPhases;
+
+        // one extra row, so interpolating from the last phase doesn't need a wrap
+        const double cutoff = preset.bandwidth * juce::jmin(1.0, outputRate / inputRate);
+        const int tableTaps = numTaps, tableHalfTaps = halfTaps, tablePhases = numPhases;
+        const double kaiserBeta = preset.kaiserBeta;
+        pKernelTable = juce_igutil::TableCache::getInstance().acquire(
+            juce::String("SampleRateConverter kernel, beta ") + juce::String(kaiserBeta) + juce::String(", cutoff ") + juce::String(cutoff, 12) +
+                juce::String(", ") + juce::String(numTaps) + juce::String(" taps"),
+            (size_t) ((numPhases + 1) * numTaps),
+            sizeof(SAMPLE_TYPE) == sizeof(double),
+            [=](double * pDest, size_t) {
+                const double besselBeta = besselI0(kaiserBeta);
+                for (int phase = 0; phase <= tablePhases; ++phase) {
+                    const double frac = (double) phase / tablePhases;
+                    double * pRow = pDest + phase * tableTaps;
+
+                    // each row normalised to unity gain at DC
+                    double sum = 0.0;
+                    for (int tap = 0; tap < tableTaps; ++tap) {
+                        const double x = (tap - tableHalfTaps + 1) - frac;
+                        const double w = x / tableHalfTaps;
+                        const double window = std::abs(w) < 1.0 ? besselI0(kaiserBeta * std::sqrt(1.0 - w * w)) / besselBeta : 0.0;
+                        const double t = juce::MathConstants<double>::pi * cutoff * x;
+                        pRow[tap] = cutoff * (x == 0.0 ? 1.0 : std::sin(t) / t) * window;
+                        sum += pRow[tap];
+                    }
+                    for (int tap = 0; tap < tableTaps; ++tap) {
+                        pRow[tap] /= sum;
+                    }
+                }
+            });
+
+        historySize = numTaps + maxInputSamples;
+        arena.allocateChannels(pHistory, numChannels, (size_t) historySize);
+        reset();
+
+        pKernelTable->waitUntilReady();
+        pKernelTable->getData(pKernel);
+    }
+
+    // Forget the input so far.  Real-time safe.
+    void reset()
+    {
+        for (int chan = 0; chan < numChannels; ++chan) {
+            juce::FloatVectorOperations::clear(pHistory[chan], historySize);
+        }
+
+        // half the taps of silence before the first sample, and the first output on it
+        numBuffered = halfTaps - 1;
+        position = halfTaps - 1;
+    }
+
+    // The most output process() can give for this much input.
+    inline int getMaxOutputSamples(const int numInputSamples) const
+    {
+        return (int) std::ceil(numInputSamples / step) + 1;
+    }
+
+    // How far behind the input the output runs, in input samples, before it can be computed.
+    inline int getLookaheadSamples() const { return halfTaps; }
+
+    inline int getNumTaps() const { return numTaps; }
+    inline double getInputRate() const { return inputRate; }
+    inline double getOutputRate() const { return outputRate; }
+
+    /**
+     * Convert.  Real-time safe.
+     *
+     * @param input - input samples
+     * @param inputStart - first one to use
+     * @param numInputSamples - up to the prepared maximum
+     * @param output - where the output goes; needs room for
+     *               getMaxOutputSamples(numInputSamples) from outputStart
+     * @param outputStart - first output sample to write
+     *
+     * @return how many output samples were written
+     */
+    int process(
+        const juce::AudioBuffer<SAMPLE_TYPE> & input,
+        const int inputStart,
+        const int numInputSamples,
+        juce::AudioBuffer<SAMPLE_TYPE> & output,
+        const int outputStart)
+    {
+        jassert(numInputSamples <= maxInputSamples);
+        const int numChannelsToUse = juce::jmin(numChannels, juce::jmin(input.getNumChannels(), output.getNumChannels()));
+
+        for (int chan = 0; chan < numChannelsToUse; ++chan) {
+            juce::FloatVectorOperations::copy(pHistory[chan] + numBuffered, input.getReadPointer(chan, inputStart), numInputSamples);
+        }
+        numBuffered += numInputSamples;
+
+        // every output whose kernel is covered by what's buffered
+        int numOutput = 0;
+        double endPosition = position;
+        while ((int) endPosition + halfTaps < numBuffered) {
+            endPosition += step;
+            ++numOutput;
+        }
+
+        for (int chan = 0; chan < numChannelsToUse; ++chan) {
+            const SAMPLE_TYPE * pIn = pHistory[chan];
+            SAMPLE_TYPE * pOut = output.getWritePointer(chan, outputStart);
+            double channelPosition = position;
+            for (int i = 0; i < numOutput; ++i) {
+                const int base = (int) channelPosition;
+                const double phase = (channelPosition - base) * numPhases;
+                const int row = (int) phase;
+                pOut[i] = interpolate(pIn + base - halfTaps + 1, pKernel + row * numTaps, (SAMPLE_TYPE) (phase - row));
+                channelPosition += step;
+            }
+        }
+
+        // keep just the history the next output needs (converting down by a lot, that can be none)
+        const int numToDiscard = juce::jlimit(0, numBuffered, (int) endPosition - halfTaps + 1);
+        for (int chan = 0; chan < numChannels; ++chan) {
+            std::memmove(pHistory[chan], pHistory[chan] + numToDiscard, sizeof(SAMPLE_TYPE) * (size_t) (numBuffered - numToDiscard));
+        }
+        numBuffered -= numToDiscard;
+        position = endPosition - numToDiscard;
+
+        return numOutput;
+    }
+
+private:
+
+    struct Preset {
+        int numTaps;
+        int numPhases;
+        double kaiserBeta;
+        double bandwidth;
+    };
+
+    /**
+     * The input window against two neighbouring kernel rows at once, blended
+     * by frac.  Four independent sums per row so the compiler can vectorise
+     * it; numTaps is always a multiple of four.
+     */
+    inline SAMPLE_TYPE interpolate(const SAMPLE_TYPE * juce_restrict pIn, const SAMPLE_TYPE * juce_restrict pRow, const SAMPLE_TYPE frac) const
+    {
+        const SAMPLE_TYPE * juce_restrict pNext = pRow + numTaps;
+        SAMPLE_TYPE a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+        SAMPLE_TYPE b0 = 0, b1 = 0, b2 = 0, b3 = 0;
+        for (int tap = 0; tap < numTaps; tap += 4) {
+            a0 += pIn[tap] * pRow[tap];
+            a1 += pIn[tap + 1] * pRow[tap + 1];
+            a2 += pIn[tap + 2] * pRow[tap + 2];
+            a3 += pIn[tap + 3] * pRow[tap + 3];
+            b0 += pIn[tap] * pNext[tap];
+            b1 += pIn[tap + 1] * pNext[tap + 1];
+            b2 += pIn[tap + 2] * pNext[tap + 2];
+            b3 += pIn[tap + 3] * pNext[tap + 3];
+        }
+        const SAMPLE_TYPE a = (a0 + a1) + (a2 + a3);
+        const SAMPLE_TYPE b = (b0 + b1) + (b2 + b3);
+        return a + frac * (b - a);
+    }
+
+    // Zeroth-order modified Bessel function of the first kind, for the Kaiser window.
+    static double besselI0(const double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 50; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < sum * 1e-17) break;
+        }
+        return sum;
+    }
+
+    const Quality quality;
+
+    double inputRate = 44100.0;
+    double outputRate = 44100.0;
+    double step = 1.0;
+    int numChannels = 0;
+    int maxInputSamples = 0;
+
+    int numTaps = 0;
+    int halfTaps = 0;
+    int numPhases = 0;
+
+    // input samples in the history, and where the next output is, in input samples from its start
+    int numBuffered = 0;
+    double position = 0.0;
+
+    // Shared kernel table, [phase][tap]
+    std::shared_ptr<const juce_igutil::TableCache::Table> pKernelTable;
+    const SAMPLE_TYPE * pKernel = nullptr;
+
+    // Refers to arena memory.
+    SAMPLE_TYPE ** pHistory = nullptr;   // [channel][sample]
+    int historySize = 0;
+};
+
+} // AUDIO_PROCESSING_NAMESPACE
@@ -0,0 +1,517 @@
+/**
+ * SamplerVoice
+ *
+ * Sample playback from disk:  only the head of each sample is held in
+ * memory, and the rest is streamed from memory-mapped files by a background
+ * thread into a lock-free ring per voice.  processBlock() never waits on I/O.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
+#include "audio_processing_header.h"
+
+#include "ProcessorNode.h"
+
+#include "../juce_igutil/MemoryAccounting.h"
+#include "../juce_igutil/MTLogger.h"
+
+namespace AUDIO_PROCESSING_NAMESPACE {
+
+/**
+ * One sample on disk.  The first headLength samples are read into memory
+ * when it's loaded, so a voice can start playing it straight away; the
+ * rest is left to the SampleStreamer.  WAV and AIFF files are memory-mapped
+ * (the whole file if the address space allows, a section at a time if not);
+ * other formats fall back to a normal reader.
+ *
+ * Sounds must outlive every voice that plays them.
+ */
+class SamplerSound
+{
+public:
+
+    /**
+     * Open the file and read the head.  Not real-time safe.
+     *
+     * @param file - the sample
+     * @param formatManager - must have its formats registered already
+     * @param _headLength - samples held in memory; enough to cover the
+     *                    time it takes the streamer to get going
+     */
+    SamplerSound(
+        const juce::File & file,
+        juce::AudioFormatManager & formatManager,
+        const int _headLength = 65536)
+    {
+        if (juce::AudioFormat * pFormat = formatManager.findFormatForFileExtension(file.getFileExtension())) {
+            pMappedReader.reset(pFormat->createMemoryMappedReader(file));
+        }
+
+        if (pMappedReader) {
+            entireFileMapped = pMappedReader->mapEntireFile();
+            pReader = pMappedReader.get();
+        }
+        else {
+            pPlainReader.reset(formatManager.createReaderFor(file));
+            pReader = pPlainReader.get();
+        }
+
+        if ( !pReader ) return;
+
+        numChannels = (int) pReader->numChannels;
+        lengthInSamples = pReader->lengthInSamples;
+        sampleRate = pReader->sampleRate;
+        headLength = (int) juce::jmin((juce::int64) _headLength, lengthInSamples);
+
+        // read in float, like every format reader, then held in SAMPLE_TYPE
+        juce::AudioBuffer<float> floatHead(numChannels, headLength);
+        readFromDisk(floatHead, 0, headLength);
+        head.setSize(numChannels, headLength);
+        for (int chan = 0; chan < numChannels; ++chan) {
+            const float * pSource = floatHead.getReadPointer(chan);
+            SAMPLE_TYPE * pDest = head.getWritePointer(chan);
+            for (int i = 0; i < headLength; ++i) pDest[i] = (SAMPLE_TYPE) pSource[i];
+        }
+    }
+
+    // Destruct
+    virtual ~SamplerSound() = default;
+
+    inline bool isOpen() const { return pReader != nullptr; }
+    inline int getNumChannels() const { return numChannels; }
+    inline juce::int64 getLengthInSamples() const { return lengthInSamples; }
+    inline double getSampleRate() const { return sampleRate; }
+    inline int getHeadLength() const { return headLength; }
+
+    // The head of one channel.
+    inline const SAMPLE_TYPE * getHead(const int channel) const { return head.getReadPointer(channel); }
+
+    /**
+     * Read from the file into the start of dest.  Streamer thread only (and
+     * the constructor):  readers aren't thread safe.
+     */
+    void readFromDisk(juce::AudioBuffer<float> & dest, const juce::int64 position, const int numSamples) const
+    {
+        if (pMappedReader && !entireFileMapped) {
+            const juce::Range<juce::int64> section(position, position + numSamples);
+            if ( !pMappedReader->getMappedSection().contains(section) ) {
+                pMappedReader->mapSectionOfFile(section.withEnd(juce::jmin(lengthInSamples, position + juce::jmax((juce::int64) numSamples, sectionLength))));
+            }
+        }
+        pReader->read(&dest, 0, numSamples, position, true, true);
+    }
+
+private:
+
+    // When the whole file can't be mapped, map this much at a time.
+    static const juce::int64 sectionLength = 1 << 22;
+
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> pMappedReader;
+    std::unique_ptr<juce::AudioFormatReader> pPlainReader;
+    juce::AudioFormatReader * pReader = nullptr;
+    bool entireFileMapped = false;
+
+    int numChannels = 0;
+    juce::int64 lengthInSamples = 0;
+    double sampleRate = 0.0;
+
+    int headLength = 0;
+    juce::AudioBuffer<SAMPLE_TYPE> head;
+};
+
+class SamplerVoice;
+
+/**
+ * The background thread that keeps every voice's ring topped up, in
+ * chunks, from its sound's file.  It also logs voices' underruns.  One
+ * streamer serves any number of voices.
+ */
+class SampleStreamer
+{
+public:
+
+    /**
+     * Construct.  Starts the thread.
+     *
+     * @param _pMTL - MT logger, for underruns
+     * @param _chunkSize - most samples read for a voice at a time
+     * @param _pollMillis - how often the thread looks for room in the rings
+     */
+    SampleStreamer(
+        std::shared_ptr<juce_igutil::MTLogger> _pMTL,
+        const int _chunkSize = 8192,
+        const int _pollMillis = 2
+    ):
+        pMTL(_pMTL),
+        chunkSize(_chunkSize),
+        pollMillis(_pollMillis)
+    {
+        streamThread = std::thread([this]() { streamLoop(); });
+    }
+
+    // Destruct.  Stops the thread.  All voices have to be gone already.
+    virtual ~SampleStreamer()
+    {
+        stopping.store(true);
+        if (streamThread.joinable()) streamThread.join();
+        jassert(voices.empty());
+    }
+
+    inline int getChunkSize() const { return chunkSize; }
+
+    // Start and stop serving a voice.  Not real-time safe.  Once removeVoice() returns, the thread won't touch it.
+    inline void addVoice(SamplerVoice * pVoice);
+    inline void removeVoice(SamplerVoice * pVoice);
+
+private:
+
+    // Service every voice, then sleep.  The lock is only ever contended by add/removeVoice().
+    inline void streamLoop();
+
+    std::shared_ptr<juce_igutil::MTLogger> pMTL;
+    const int chunkSize;
+    const int pollMillis;
+
+    std::mutex voicesMutex;
+    std::vector<SamplerVoice *> voices;
+
+    // Streamer thread only.
+    juce::AudioBuffer<float> scratch;
+
+    std::atomic<bool> stopping{ false };
+    std::thread streamThread;
+};
+
+/**
+ * Plays a SamplerSound, adding it into the buffer.  The head comes straight
+ * from memory; after that the voice reads from its ring, which the streamer
+ * fills from the file behind it.
+ *
+ * The ring is single-producer (streamer) single-consumer (voice), with
+ * ever-increasing read and write counts.  Starting a note bumps a
+ * generation number; the streamer answers with the ring position its data
+ * for the new note starts at, and the voice plays from the head until it
+ * does.  If the ring runs dry anyway, the rest of the block is silent, the
+ * voice waits where it is, and the underrun is counted - never a wait on
+ * the audio thread.
+ *
+ * Sounds play at their own sample rate; there is no pitch or rate
+ * conversion.  The ring comes from the arena.
+ */
+class SamplerVoice : public ProcessorNode
+{
+public:
+
+    /**
+     * Construct.
+     *
+     * @param _pStreamer - the streamer to fill this voice's ring
+     * @param _ringSize - ring length in samples, a power of two, at least
+     *                  a couple of streamer chunks
+     * @param _releaseLength - fade-out length in samples after stopNote()
+     */
+    SamplerVoice(
+        std::shared_ptr<SampleStreamer> _pStreamer,
+        const int _ringSize = 32768,
+        const int _releaseLength = 256
+    ):
+        pStreamer(_pStreamer),
+        ringSize(_ringSize),
+        releaseLength(_releaseLength)
+    {
+        jassert(juce::isPowerOfTwo(ringSize) && ringSize >= 2 * pStreamer->getChunkSize());
+        jassert(releaseLength > 0);
+    }
+
+    // Destruct
+    virtual ~SamplerVoice()
+    {
+        pStreamer->removeVoice(this);
+    }
+
+    // Carve out the ring and start being served.
+    void prepare(
+        const double sampleRate,
+        const int maxBlockSize,
+        const int _numChannels,
+        juce_igutil::AlignedArena & arena) override
+    {
+        // the streamer mustn't touch the old ring while it's replaced
+        pStreamer->removeVoice(this);
+
+        numChannels = _numChannels;
+        arena.allocateChannels(pRing, numChannels, (size_t) ringSize);
+        pSources = static_cast<const SAMPLE_TYPE **>(arena.allocateBytes(sizeof(SAMPLE_TYPE *) * (size_t) numChannels));
+
+        pSound = nullptr;
+        ringAttached = false;
+        requestStream(nullptr);
+
+        pStreamer->addVoice(this);
+    }
+
+    /**
+     * Start playing a sound from the beginning.  Real-time safe.
+     *
+     * @param sound - must stay loaded until the voice is done with it
+     * @param _gain - linear gain
+     */
+    void startNote(const SamplerSound * sound, const SAMPLE_TYPE _gain = 1)
+    {
+        jassert(sound != nullptr && sound->isOpen());
+        pSound = sound;
+        gain = _gain;
+        position = 0;
+        releaseRemaining = -1;
+        ringAttached = false;
+        requestStream(sound);
+    }
+
+    // Fade out and stop.  Real-time safe.
+    void stopNote()
+    {
+        if (pSound && releaseRemaining < 0) releaseRemaining = releaseLength;
+    }
+
+    inline bool isPlaying() const { return pSound != nullptr; }
+
+    // Add the next numSamples of the sound into the buffer.
+    void process(
+        juce::AudioBuffer<SAMPLE_TYPE> & buffer,
+        int startSample,
+        int numSamples) override
+    {
+        while (numSamples > 0 && pSound) {
+            if (position >= pSound->getLengthInSamples()) {
+                finish();
+                break;
+            }
+
+            int numToMix = numSamples;
+            if (releaseRemaining >= 0) numToMix = juce::jmin(numToMix, releaseRemaining);
+
+            const int soundChannels = pSound->getNumChannels();
+            const bool fromRing = position >= pSound->getHeadLength();
+            if ( !fromRing ) {
+                // from memory
+                numToMix = juce::jmin(numToMix, (int) (pSound->getHeadLength() - position));
+                for (int chan = 0; chan < numChannels; ++chan) {
+                    pSources[chan] = pSound->getHead(chan % soundChannels) + position;
+                }
+            }
+            else {
+                // from the ring, once the streamer has started on this note
+                if ( !ringAttached && ackGeneration.load(std::memory_order_acquire) == generation ) {
+                    readIndex.store(ringStart.load(std::memory_order_relaxed), std::memory_order_release);
+                    ringAttached = true;
+                }
+                const juce::uint64 numAvailable = ringAttached ? writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_relaxed) : 0;
+                const int ringOffset = (int) (readIndex.load(std::memory_order_relaxed) & (juce::uint64) (ringSize - 1));
+                numToMix = (int) juce::jmin((juce::uint64) numToMix, numAvailable, (juce::uint64) (ringSize - ringOffset));
+                numToMix = (int) juce::jmin((juce::int64) numToMix, pSound->getLengthInSamples() - position);
+
+                if (numToMix <= 0) {
+                    // ran dry:  silence for the rest of the block, and carry on from here next time
+                    numUnderruns.fetch_add(1, std::memory_order_relaxed);
+                    numUnderrunSamples.fetch_add((juce::uint64) numSamples, std::memory_order_relaxed);
+                    break;
+                }
+
+                for (int chan = 0; chan < numChannels; ++chan) {
+                    pSources[chan] = pRing[chan] + ringOffset;
+                }
+            }
+
+            mix(buffer, startSample, numToMix);
+            if (fromRing && pSound) {
+                // only once it's been read can the streamer have it back
+                readIndex.store(readIndex.load(std::memory_order_relaxed) + (juce::uint64) numToMix, std::memory_order_release);
+            }
+            position += numToMix;
+            startSample += numToMix;
+            numSamples -= numToMix;
+        }
+    }
+
+    // Stop, and stop being served.
+    void releaseResources() override
+    {
+        pStreamer->removeVoice(this);
+        pSound = nullptr;
+    }
+
+    // Blocks that ran out of streamed samples, and the samples of silence they cost.  Any thread.
+    inline juce::uint64 getNumUnderruns() const { return numUnderruns.load(std::memory_order_relaxed); }
+    inline juce::uint64 getNumUnderrunSamples() const { return numUnderrunSamples.load(std::memory_order_relaxed); }
+
+private:
+
+    friend class SampleStreamer;
+
+    /**
+     * Ask the streamer to start on a sound (or stop, with nullptr).  Audio
+     * thread.  Whatever's left in the ring is dropped, so the streamer has
+     * room to fill it for the new note while the head plays.
+     */
+    void requestStream(const SamplerSound * sound)
+    {
+        readIndex.store(writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+        ++generation;
+        requestedSound.store(sound, std::memory_order_relaxed);
+        requestedGeneration.store(generation, std::memory_order_release);
+    }
+
+    void finish()
+    {
+        pSound = nullptr;
+        requestStream(nullptr);
+    }
+
+    // Add numToMix samples from pSources, with the gain and any release fade.
+    void mix(juce::AudioBuffer<SAMPLE_TYPE> & buffer, const int startSample, const int numToMix)
+    {
+        const int numChannelsToUse = juce::jmin(numChannels, buffer.getNumChannels());
+        if (releaseRemaining < 0) {
+            for (int chan = 0; chan < numChannelsToUse; ++chan) {
+                buffer.addFrom(chan, startSample, pSources[chan], numToMix, gain);
+            }
+            return;
+        }
+
+        const SAMPLE_TYPE startGain = gain * (SAMPLE_TYPE) releaseRemaining / (SAMPLE_TYPE) releaseLength;
+        const SAMPLE_TYPE endGain = gain * (SAMPLE_TYPE) (releaseRemaining - numToMix) / (SAMPLE_TYPE) releaseLength;
+        for (int chan = 0; chan < numChannelsToUse; ++chan) {
+            buffer.addFromWithRamp(chan, startSample, pSources[chan], numToMix, startGain, endGain);
+        }
+        releaseRemaining -= numToMix;
+        if (releaseRemaining == 0) finish();
+    }
+
+    /**
+     * Streamer thread:  pick up a new note, then read as much of the file
+     * into the ring as there's room for, up to a chunk.
+     */
+    void serviceStream(juce::AudioBuffer<float> & scratch)
+    {
+        const juce::uint64 requested = requestedGeneration.load(std::memory_order_acquire);
+        if (requested != streamGeneration) {
+            streamGeneration = requested;
+            pStreamSound = requestedSound.load(std::memory_order_relaxed);
+            streamPosition = pStreamSound ? pStreamSound->getHeadLength() : 0;
+            ringStart.store(writeIndex.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            ackGeneration.store(requested, std::memory_order_release);
+        }
+
+        if ( !pStreamSound ) return;
+        const juce::int64 numLeft = pStreamSound->getLengthInSamples() - streamPosition;
+        if (numLeft <= 0) return;
+
+        // Wait for room for a whole chunk, unless it's the last one.
+        const juce::uint64 write = writeIndex.load(std::memory_order_relaxed);
+        const juce::uint64 numFree = (juce::uint64) ringSize - (write - readIndex.load(std::memory_order_acquire));
+        const int chunkSize = (int) juce::jmin((juce::int64) scratch.getNumSamples(), numLeft);
+        if (numFree < (juce::uint64) chunkSize) return;
+
+        const int soundChannels = pStreamSound->getNumChannels();
+        scratch.setSize(soundChannels, scratch.getNumSamples(), false, false, true);
+        pStreamSound->readFromDisk(scratch, streamPosition, chunkSize);
+
+        const int ringOffset = (int) (write & (juce::uint64) (ringSize - 1));
+        const int numBeforeWrap = juce::jmin(chunkSize, ringSize - ringOffset);
+        for (int chan = 0; chan < numChannels; ++chan) {
+            const float * pSource = scratch.getReadPointer(chan % soundChannels);
+            SAMPLE_TYPE * pDest = pRing[chan];
+            for (int i = 0; i < numBeforeWrap; ++i) pDest[ringOffset + i] = (SAMPLE_TYPE) pSource[i];
+            for (int i = numBeforeWrap; i < chunkSize; ++i) pDest[i - numBeforeWrap] = (SAMPLE_TYPE) pSource[i];
+        }
+
+        streamPosition += chunkSize;
+        writeIndex.store(write + (juce::uint64) chunkSize, std::memory_order_release);
+    }
+
+    // Streamer thread:  log any underruns since the last report.
+    void reportUnderruns(juce_igutil::MTLogger & logger)
+    {
+        const juce::uint64 underruns = getNumUnderruns();
+        if (underruns != reportedUnderruns) {
+            logger.warning(juce::String("SAMPLER:  voice ran out of streamed samples ") + juce::String(underruns - reportedUnderruns) +
+                juce::String(" more time(s), ") + juce::String(underruns) + juce::String(" blocks and ") +
+                juce::String(getNumUnderrunSamples()) + juce::String(" samples in all"));
+            reportedUnderruns = underruns;
+        }
+    }
+
+    std::shared_ptr<SampleStreamer> pStreamer;
+    const int ringSize;
+    const int releaseLength;
+    int numChannels = 0;
+
+    // Audio thread only.
+    const SamplerSound * pSound = nullptr;
+    SAMPLE_TYPE gain = 1;
+    juce::int64 position = 0;
+    int releaseRemaining = -1;       // -1 while not releasing
+    juce::uint64 generation = 0;
+    bool ringAttached = false;
+
+    // Streamer thread only.
+    const SamplerSound * pStreamSound = nullptr;
+    juce::int64 streamPosition = 0;
+    juce::uint64 streamGeneration = 0;
+    juce::uint64 reportedUnderruns = 0;
+
+    // Between the two.
+    std::atomic<const SamplerSound *> requestedSound{ nullptr };
+    std::atomic<juce::uint64> requestedGeneration{ 0 };
+    std::atomic<juce::uint64> ackGeneration{ 0 };
+    std::atomic<juce::uint64> ringStart{ 0 };
+    std::atomic<juce::uint64> writeIndex{ 0 };
+    std::atomic<juce::uint64> readIndex{ 0 };
+
+    std::atomic<juce::uint64> numUnderruns{ 0 };
+    std::atomic<juce::uint64> numUnderrunSamples{ 0 };
+
+    // Both refer to arena memory.
+    SAMPLE_TYPE ** pRing = nullptr;             // [channel][ringSize]
+    const SAMPLE_TYPE ** pSources = nullptr;    // per channel, where mix() reads from
+};
+
+//==============================================================================
+inline void SampleStreamer::addVoice(SamplerVoice * pVoice)
+{
+    std::lock_guard<std::mutex> lock(voicesMutex);
+    if (std::find(voices.begin(), voices.end(), pVoice) == voices.end()) voices.push_back(pVoice);
+}
+
+inline void SampleStreamer::removeVoice(SamplerVoice * pVoice)
+{
+    std::lock_guard<std::mutex> lock(voicesMutex);
+    voices.erase(std::remove(voices.begin(), voices.end(), pVoice), voices.end());
+}
+
+inline void SampleStreamer::streamLoop()
+{
+    juce_igutil::AllocationCounter::setThreadName("sample streamer");
+    scratch.setSize(2, chunkSize);
+    while ( !stopping.load() ) {
+        {
+            std::lock_guard<std::mutex> lock(voicesMutex);
+            for (SamplerVoice * pVoice : voices) {
+                pVoice->serviceStream(scratch);
+                pVoice->reportUnderruns(*pMTL);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(pollMillis));
+    }
+}
+
+} // AUDIO_PROCESSING_NAMESPACE
@@ -13,6 +13,8 @@
 // This provides the AUDIO_PROCESSING_NAMESPACE name and the SAMPLE_TYPE #defines.
 #include "audio_processing_header.h"
 
+#include "ProcessorNode.h"
+
 #define TWOPI (juce::MathConstants<SAMPLE_TYPE>::twoPi)
 
 namespace AUDIO_PROCESSING_NAMESPACE {
@@ -21,7 +23,7 @@ namespace AUDIO_PROCESSING_NAMESPACE {
  * Fake synthesiser class that renders multiple sine waves regardless of midi 
  * input.  Note the lack of templatization. 
  */
-class SineWaveSynthesiser
+class SineWaveSynthesiser : public ProcessorNode
 {
 public:
     
@@ -46,6 +48,25 @@ public:
         radiansDelta = cyclesPerSample * TWOPI;
     }
 
+    // ProcessorNode prepare.  The synth needs no scratch memory.
+    void prepare(
+        const double sampleRate,
+        const int maxBlockSize,
+        const int numChannels,
+        juce_igutil::AlignedArena & arena) override
+    {
+        prepare(sampleRate);
+    }
+
+    // ProcessorNode process:  renders on top of whatever is in the buffer.
+    void process(
+        juce::AudioBuffer<SAMPLE_TYPE> & buffer,
+        int startSample,
+        int numSamples) override
+    {
+        renderNextBlock(buffer, startSample, numSamples);
+    }
+
     /**
      * Render the next block.  Expects an AudioBuffer of a specific, concrete 
      * SAMPLE_TYPE, as defined in the audio_processing_header. 
@@ -75,8 +96,13 @@ public:
         }
     }
 
+    // The phase, so the other precision's synth carries on where this one is.
+    int getNumStateValues() const override { return 1; }
+    void saveState(double * pState) const override { pState[0] = currentRadians; }
+    void loadState(const double * pState) override { currentRadians = static_cast<SAMPLE_TYPE>(pState[0]); }
+
     // Reset and clean up any resources.
-    void releaseResources() 
+    void releaseResources() override
     {
         radiansDelta = 0.0;
     }
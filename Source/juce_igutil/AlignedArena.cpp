@@ -0,0 +1,219 @@
+
+#include "AlignedArena.h"
+
+#if JUCE_WINDOWS
+ #include <malloc.h>
+ #include <windows.h>
+#else
+ #include <stdlib.h>
+ #include <sys/mman.h>
+#endif
+
+using namespace juce_igutil;
+
+namespace {
+
+inline size_t roundUp(const size_t value, const size_t multiple)
+{
+    return ((value + multiple - 1) / multiple) * multiple;
+}
+
+}
+
+/**
+ * Construct.
+ */
+AlignedArena::AlignedArena(const size_t _minimumBlockSize, const bool _useHugePages) :
+    minimumBlockSize(roundUp(_minimumBlockSize, alignment)),
+    useHugePages(_useHugePages)
+{
+    // empty
+}
+
+/**
+ * Destruct.
+ */
+AlignedArena::~AlignedArena()
+{
+    for (auto& block : blocks)
+        freeBlock(block);
+}
+
+/**
+ * Get a block from the OS.  Huge pages are only attempted for blocks big
+ * enough to fill one; if the OS refuses (e.g. no SeLockMemoryPrivilege on
+ * Windows) we quietly fall back to normal pages.
+ */
+AlignedArena::Block AlignedArena::allocateBlock(const size_t size) const
+{
+    Block block;
+    block.size = roundUp(size, alignment);
+
+    if (useHugePages && block.size >= hugePageSize) {
+        const size_t hugeSize = roundUp(block.size, hugePageSize);
+       #if JUCE_WINDOWS
+        const size_t largePageMinimum = GetLargePageMinimum();
+        if (largePageMinimum > 0) {
+            const size_t largeSize = roundUp(block.size, largePageMinimum);
+            void* p = VirtualAlloc(nullptr, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (p == nullptr)
+                p = VirtualAlloc(nullptr, largeSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            if (p != nullptr) {
+                block.pData = static_cast<char*>(p);
+                block.size = largeSize;
+                block.isHugePage = true;
+                return block;
+            }
+        }
+       #else
+        void* p = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+           #ifdef MADV_HUGEPAGE
+            madvise(p, hugeSize, MADV_HUGEPAGE);
+           #endif
+            block.pData = static_cast<char*>(p);
+            block.size = hugeSize;
+            block.isHugePage = true;
+            return block;
+        }
+       #endif
+        juce::ignoreUnused(hugeSize);
+    }
+
+   #if JUCE_WINDOWS
+    block.pData = static_cast<char*>(_aligned_malloc(block.size, alignment));
+   #else
+    void* p = nullptr;
+    if (posix_memalign(&p, alignment, block.size) == 0)
+        block.pData = static_cast<char*>(p);
+   #endif
+
+    if (block.pData == nullptr)
+        throw std::bad_alloc();
+
+    return block;
+}
+
+/**
+ * Give a block back to the OS.
+ */
+void AlignedArena::freeBlock(Block& block) const
+{
+    if (block.pData == nullptr) return;
+
+   #if JUCE_WINDOWS
+    if (block.isHugePage) VirtualFree(block.pData, 0, MEM_RELEASE);
+    else _aligned_free(block.pData);
+   #else
+    if (block.isHugePage) munmap(block.pData, block.size);
+    else free(block.pData);
+   #endif
+
+    block.pData = nullptr;
+    block.size = 0;
+}
+
+/**
+ * Rewind, merging blocks if the last round outgrew the first one.
+ */
+void AlignedArena::reset()
+{
+    if (blocks.size() > 1) {
+        const size_t total = getBytesReserved();
+        for (auto& block : blocks)
+            freeBlock(block);
+        blocks.clear();
+        blocks.push_back(allocateBlock(total));
+    }
+
+    currentBlock = 0;
+    offsetInBlock = 0;
+    bytesUsed = 0;
+    sealed = false;
+}
+
+/**
+ * Reserve.
+ */
+void AlignedArena::reserve(const size_t numBytes)
+{
+    size_t available = 0;
+    for (size_t i = currentBlock; i < blocks.size(); ++i)
+        available += blocks[i].size - (i == currentBlock ? offsetInBlock : 0);
+
+    if (available < numBytes) {
+        blocks.push_back(allocateBlock(juce::jmax(numBytes, minimumBlockSize)));
+    }
+}
+
+/**
+ * Bump-allocate from the current block, moving on to (or adding) another
+ * block when it's full.
+ */
+void* AlignedArena::allocateBytes(const size_t numBytes)
+{
+    const size_t size = roundUp(juce::jmax(numBytes, (size_t)1), alignment);
+
+    while (currentBlock < blocks.size() && offsetInBlock + size > blocks[currentBlock].size) {
+        ++currentBlock;
+        offsetInBlock = 0;
+    }
+
+    if (currentBlock >= blocks.size()) {
+        // Getting here after seal() means something allocates during processing.
+        jassert( !sealed );
+        if (sealed) ++numLateAllocations;
+
+        blocks.push_back(allocateBlock(juce::jmax(size, minimumBlockSize)));
+        currentBlock = blocks.size() - 1;
+        offsetInBlock = 0;
+    }
+
+    char* p = blocks[currentBlock].pData + offsetInBlock;
+    offsetInBlock += size;
+    bytesUsed += size;
+    return p;
+}
+
+/**
+ * Sample array allocation.
+ */
+void AlignedArena::allocate(float*& pDest, const size_t numSamples)
+{
+    pDest = static_cast<float*>(allocateBytes(numSamples * sizeof(float)));
+    std::memset(pDest, 0, numSamples * sizeof(float));
+}
+
+void AlignedArena::allocate(double*& pDest, const size_t numSamples)
+{
+    pDest = static_cast<double*>(allocateBytes(numSamples * sizeof(double)));
+    std::memset(pDest, 0, numSamples * sizeof(double));
+}
+
+/**
+ * Channel allocation.  Each channel starts on its own cache line.
+ */
+void AlignedArena::allocateChannels(float**& pDest, const int numChannels, const size_t numSamples)
+{
+    pDest = static_cast<float**>(allocateBytes(numChannels * sizeof(float*)));
+    for (int chan = 0; chan < numChannels; ++chan)
+        allocate(pDest[chan], numSamples);
+}
+
+void AlignedArena::allocateChannels(double**& pDest, const int numChannels, const size_t numSamples)
+{
+    pDest = static_cast<double**>(allocateBytes(numChannels * sizeof(double*)));
+    for (int chan = 0; chan < numChannels; ++chan)
+        allocate(pDest[chan], numSamples);
+}
+
+/**
+ * Total held from the OS.
+ */
+size_t AlignedArena::getBytesReserved() const
+{
+    size_t total = 0;
+    for (const auto& block : blocks)
+        total += block.size;
+    return total;
+}
@@ -0,0 +1,104 @@
+// Aligned Arena Allocator
+//
+// Hands out cache-line-aligned scratch memory for audio processing.  Everything is
+// carved out at prepare time and the arena is reset (not freed) on the next prepare,
+// so nothing allocates inside processBlock() no matter how many processors share it.
+// Large arenas are backed by huge pages where the OS allows it.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <vector>
+
+namespace juce_igutil {
+
+class AlignedArena {
+
+public:
+
+    // Alignment of every allocation.  One cache line; also enough for any SIMD register.
+    static const size_t alignment = 64;
+
+    // Blocks at least this large are backed by huge pages, when enabled.
+    static const size_t hugePageSize = 2 * 1024 * 1024;
+
+    /**
+     * Construct.  Nothing is allocated until the first allocate() or
+     * reserve().
+     *
+     * @param _minimumBlockSize - the smallest block to allocate from the
+     *                          OS.
+     * @param _useHugePages - try to back large blocks with huge pages.
+     */
+    AlignedArena(const size_t _minimumBlockSize = 64 * 1024, const bool _useHugePages = true);
+
+    // Destruct.  Frees all blocks.
+    virtual ~AlignedArena();
+
+    /**
+     * Rewind to empty.  Memory is kept for the next round of allocations.
+     * If the last round needed more than one block, they are merged into
+     * one block big enough for all of it, so the next round is contiguous.
+     * Call only at prepare time.
+     */
+    void reset();
+
+    // Make sure the arena can hand out at least this many more bytes without another block.
+    void reserve(const size_t numBytes);
+
+    /**
+     * After sealing, the arena is expected to be big enough for everything
+     * asked of it.  An allocation that would need a new block then asserts.
+     * reset() unseals.
+     */
+    inline void seal() { sealed = true; }
+    inline bool isSealed() const { return sealed; }
+
+    // Allocate raw bytes.  Never returns nullptr.  Contents are not initialised.
+    void* allocateBytes(const size_t numBytes);
+
+    // Allocate arrays of samples, cleared to zero.  Overloaded so SAMPLE_TYPE code picks the right one.
+    void allocate(float*& pDest, const size_t numSamples);
+    void allocate(double*& pDest, const size_t numSamples);
+
+    // Allocate a channel-pointer array followed by the channels themselves, cleared to zero.
+    void allocateChannels(float**& pDest, const int numChannels, const size_t numSamples);
+    void allocateChannels(double**& pDest, const int numChannels, const size_t numSamples);
+
+    // Bytes handed out since the last reset().
+    inline size_t getBytesUsed() const { return bytesUsed; }
+
+    // Bytes held from the OS.
+    size_t getBytesReserved() const;
+
+    // Number of times a block had to be added after seal().  Should always be 0.
+    inline int getNumLateAllocations() const { return numLateAllocations; }
+
+private:
+
+    struct Block {
+        char* pData = nullptr;
+        size_t size = 0;
+        bool isHugePage = false;
+    };
+
+    // Get memory from / give memory back to the OS.
+    Block allocateBlock(const size_t size) const;
+    void freeBlock(Block& block) const;
+
+    const size_t minimumBlockSize;
+    const bool useHugePages;
+
+    std::vector<Block> blocks;
+    size_t currentBlock = 0;
+    size_t offsetInBlock = 0;
+    size_t bytesUsed = 0;
+
+    bool sealed = false;
+    int numLateAllocations = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(AlignedArena)
+};
+
+}
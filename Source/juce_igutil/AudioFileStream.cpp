@@ -0,0 +1,225 @@
+
+#include "AudioFileStream.h"
+
+using namespace juce;
+using namespace juce_igutil;
+
+/**
+ * Construct.  Prefers a memory-mapped reader (WAV, AIFF); other formats
+ * fall back to a normal streaming reader.  Either way, the first two chunks
+ * are prefetched before this returns.
+ */
+AudioFileStreamReader::AudioFileStreamReader(
+    const File& file,
+    AudioFormatManager& formatManager,
+    const int _chunkSize
+):
+    chunkSize(_chunkSize)
+{
+    jassert(chunkSize > 0);
+
+    if (AudioFormat* pFormat = formatManager.findFormatForFileExtension(file.getFileExtension())) {
+        pMappedReader.reset(pFormat->createMemoryMappedReader(file));
+    }
+
+    if (pMappedReader) {
+        pReader = pMappedReader.get();
+    }
+    else {
+        pPlainReader.reset(formatManager.createReaderFor(file));
+        pReader = pPlainReader.get();
+    }
+
+    if ( !pReader ) return;
+
+    sampleRate = pReader->sampleRate;
+    numChannels = static_cast<int>(pReader->numChannels);
+    lengthInSamples = pReader->lengthInSamples;
+
+    // All allocation is done here, never during read().
+    for (auto& slot : slots) {
+        slot.buffer.setSize(numChannels, chunkSize);
+    }
+    fillSlot(0);
+    fillSlot(1);
+    slots[0].ready = slots[1].ready = true;
+
+    pPrefetchThread.reset(new std::thread(&AudioFileStreamReader::prefetchLoop, this));
+}
+
+/**
+ * Destruct.
+ */
+AudioFileStreamReader::~AudioFileStreamReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(slotMutex);
+        stopping = true;
+    }
+    slotCondition.notify_all();
+    if (pPrefetchThread && pPrefetchThread->joinable())
+        pPrefetchThread->join();
+}
+
+/**
+ * Read the next chunk of the file into a slot.  Only the section of the
+ * file being read is mapped, so memory use is bounded by the chunk size no
+ * matter how large the file is.
+ */
+void AudioFileStreamReader::fillSlot(const int slotIndex)
+{
+    Slot& slot = slots[slotIndex];
+    const int numToRead = static_cast<int>(jmin((int64)chunkSize, lengthInSamples - prefetchPosition));
+
+    if (numToRead > 0) {
+        const Range<int64> section(prefetchPosition, prefetchPosition + numToRead);
+        if (pMappedReader && !pMappedReader->getMappedSection().contains(section)) {
+            pMappedReader->mapSectionOfFile(section);
+        }
+        pReader->read(&slot.buffer, 0, numToRead, prefetchPosition, true, true);
+        prefetchPosition += numToRead;
+    }
+
+    slot.numValid = jmax(0, numToRead);
+}
+
+/**
+ * Wait for read() to hand back a slot, then refill it.  Slots are refilled
+ * in turn, the order read() consumes them in, so chunks stay in file order
+ * even when both come back at once.  The disk access happens outside the
+ * lock.
+ */
+void AudioFileStreamReader::prefetchLoop()
+{
+    // The constructor filled both, so slot 0 is the first to come back.
+    int nextSlotToFill = 0;
+
+    std::unique_lock<std::mutex> lock(slotMutex);
+    while ( !stopping ) {
+        slotCondition.wait(lock, [this, nextSlotToFill]() {
+            return stopping || !slots[nextSlotToFill].ready;
+        });
+        if (stopping) break;
+
+        lock.unlock();
+        fillSlot(nextSlotToFill);
+        lock.lock();
+        slots[nextSlotToFill].ready = true;
+        slotCondition.notify_all();
+        nextSlotToFill = 1 - nextSlotToFill;
+    }
+}
+
+/**
+ * Copy from the current slot, moving to the other one when it runs out.
+ * The other slot has normally been prefetched already, so the wait only
+ * blocks if the disk is slower than the render loop.
+ */
+int AudioFileStreamReader::read(AudioBuffer<float>& dest, const int numSamples)
+{
+    jassert(numSamples <= dest.getNumSamples());
+
+    int numCopied = 0;
+    while (pReader && numCopied < numSamples) {
+        Slot& slot = slots[currentSlot];
+        {
+            std::unique_lock<std::mutex> lock(slotMutex);
+            slotCondition.wait(lock, [&slot]() { return slot.ready; });
+        }
+
+        // end of file
+        if (slot.numValid == 0) break;
+
+        const int numToCopy = jmin(numSamples - numCopied, slot.numValid - positionInSlot);
+        for (int chan = 0; chan < dest.getNumChannels(); ++chan) {
+            if (chan < numChannels)
+                dest.copyFrom(chan, numCopied, slot.buffer, chan, positionInSlot, numToCopy);
+            else
+                dest.clear(chan, numCopied, numToCopy);
+        }
+        numCopied += numToCopy;
+        positionInSlot += numToCopy;
+
+        // hand the slot back to the prefetch thread
+        if (positionInSlot >= slot.numValid) {
+            {
+                std::lock_guard<std::mutex> lock(slotMutex);
+                slot.ready = false;
+            }
+            slotCondition.notify_all();
+            currentSlot = 1 - currentSlot;
+            positionInSlot = 0;
+        }
+    }
+
+    if (numCopied < numSamples) {
+        dest.clear(numCopied, numSamples - numCopied);
+    }
+    return numCopied;
+}
+
+/**
+ * Construct.  Any existing file is replaced.
+ */
+AudioFileStreamWriter::AudioFileStreamWriter(
+    const File& file,
+    AudioFormatManager& formatManager,
+    const double sampleRate,
+    const int numChannels,
+    const int bitsPerSample,
+    const int fifoSize
+):
+    writerThread("AudioFileStreamWriter"),
+    maxPieceSize(jmax(1, fifoSize / 2))
+{
+    AudioFormat* pFormat = formatManager.findFormatForFileExtension(file.getFileExtension());
+    if ( !pFormat ) return;
+
+    file.deleteFile();
+    std::unique_ptr<FileOutputStream> pStream(file.createOutputStream(diskWriteSize));
+    if ( !pStream || pStream->failedToOpen() ) return;
+
+    std::unique_ptr<AudioFormatWriter> pWriter(pFormat->createWriterFor(
+        pStream.get(), sampleRate, static_cast<unsigned int>(numChannels), bitsPerSample, {}, 0));
+    if ( !pWriter ) return;
+
+    // the writer owns the stream now
+    pStream.release();
+
+    pieceChannels.allocate((size_t) numChannels, true);
+    numWriterChannels = numChannels;
+
+    writerThread.startThread();
+    pThreadedWriter.reset(new AudioFormatWriter::ThreadedWriter(pWriter.release(), writerThread, fifoSize));
+}
+
+/**
+ * Destruct.  Deleting the ThreadedWriter flushes its FIFO, and must happen
+ * before the thread it runs on is stopped.
+ */
+AudioFileStreamWriter::~AudioFileStreamWriter()
+{
+    pThreadedWriter.reset();
+    writerThread.stopThread(10000);
+}
+
+/**
+ * Queue samples for writing, in pieces of at most half the FIFO, so any
+ * length fits.  While the FIFO is full, sleep rather than spin:  the
+ * writer thread needs a while to free up a piece's worth anyway.
+ */
+void AudioFileStreamWriter::write(const AudioBuffer<float>& source, const int numSamples)
+{
+    if ( !pThreadedWriter ) return;
+    jassert(source.getNumChannels() >= numWriterChannels && numSamples <= source.getNumSamples());
+
+    for (int start = 0; start < numSamples; start += maxPieceSize) {
+        const int numInPiece = jmin(maxPieceSize, numSamples - start);
+        for (int chan = 0; chan < numWriterChannels; ++chan)
+            pieceChannels[chan] = source.getReadPointer(chan, start);
+
+        while ( !pThreadedWriter->write(pieceChannels.get(), numInPiece) ) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(fullFifoSleepMillis));
+        }
+    }
+}
@@ -0,0 +1,162 @@
+// Streaming Audio File I/O
+//
+// Reader and writer classes used for offline rendering.  Neither one ever holds the
+// whole file in memory:  the reader memory-maps one chunk of the input at a time and
+// keeps the next chunk prefetched on a background thread (double buffering), and the
+// writer hands rendered samples to a background thread that flushes them to disk in
+// large, page-sized writes.
+//
+// Sample data is always exchanged as float, since that is what the Juce audio format
+// readers and writers deal in.  Convert at the call site for double-precision paths.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace juce_igutil {
+
+class AudioFileStreamReader {
+
+public:
+
+    /**
+     * Construct.  Opens the file and starts the prefetch thread.  Check
+     * isOpen() afterwards.
+     *
+     * @param file - the audio file to stream from
+     * @param formatManager - used to find a format for the file
+     *                      extension.  Must have its formats
+     *                      registered already.
+     * @param _chunkSize - number of samples (per channel) in each
+     *                   prefetched chunk.  Two chunks are kept in
+     *                   memory at a time.
+     */
+    AudioFileStreamReader(
+        const juce::File& file,
+        juce::AudioFormatManager& formatManager,
+        const int _chunkSize = 65536);
+
+    // Destruct.  Stops the prefetch thread.
+    virtual ~AudioFileStreamReader();
+
+    // True if the file was opened successfully.
+    inline bool isOpen() const { return pReader != nullptr; }
+
+    // True if the file is being read through a memory map (WAV and AIFF).
+    inline bool isMemoryMapped() const { return pMappedReader != nullptr; }
+
+    inline double getSampleRate() const { return sampleRate; }
+    inline int getNumChannels() const { return numChannels; }
+    inline juce::int64 getLengthInSamples() const { return lengthInSamples; }
+
+    /**
+     * Copy the next numSamples samples into the start of dest.  Channels
+     * beyond those in the file are cleared, and the remainder is cleared
+     * once the end of the file is reached.
+     *
+     * @return the number of samples actually read from the file.
+     */
+    int read(juce::AudioBuffer<float>& dest, const int numSamples);
+
+private:
+
+    // Fill the given slot with the next chunk from the file.  Prefetch thread only.
+    void fillSlot(const int slotIndex);
+
+    // Loops until stopped, filling any slot that has been consumed.
+    void prefetchLoop();
+
+    // One prefetched chunk.
+    struct Slot {
+        juce::AudioBuffer<float> buffer;
+        int numValid = 0;
+        bool ready = false;
+    };
+
+    // Exactly one of these owns the reader; pReader points at whichever it is.
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> pMappedReader;
+    std::unique_ptr<juce::AudioFormatReader> pPlainReader;
+    juce::AudioFormatReader* pReader = nullptr;
+
+    double sampleRate = 0.0;
+    int numChannels = 0;
+    juce::int64 lengthInSamples = 0;
+    const int chunkSize;
+
+    // next position in the file for the prefetch thread to read
+    juce::int64 prefetchPosition = 0;
+
+    // the slot being consumed by read(), and the read position inside it
+    Slot slots[2];
+    int currentSlot = 0;
+    int positionInSlot = 0;
+
+    // prefetch thread and protection
+    std::unique_ptr<std::thread> pPrefetchThread;
+    std::mutex slotMutex;
+    std::condition_variable slotCondition;
+    bool stopping = false;
+};
+
+class AudioFileStreamWriter {
+
+public:
+
+    /**
+     * Construct.  Creates (or replaces) the file and starts the background
+     * writer thread.  Check isOpen() afterwards.
+     *
+     * @param file - the file to write.  The format is picked from the
+     *             file extension.
+     * @param formatManager - must have its formats registered already.
+     * @param sampleRate
+     * @param numChannels
+     * @param bitsPerSample
+     * @param fifoSize - number of samples (per channel) that can be
+     *                 queued for the writer thread. Default is 1
+     *                 second at 48kHz.
+     */
+    AudioFileStreamWriter(
+        const juce::File& file,
+        juce::AudioFormatManager& formatManager,
+        const double sampleRate,
+        const int numChannels,
+        const int bitsPerSample = 24,
+        const int fifoSize = 48000);
+
+    // Destruct.  Flushes anything still queued and closes the file.
+    virtual ~AudioFileStreamWriter();
+
+    // True if the file was created successfully.
+    inline bool isOpen() const { return pThreadedWriter != nullptr; }
+
+    /**
+     * Queue samples for writing.  Any number of samples can be written;
+     * more than the FIFO holds go in pieces.  If the writer thread has
+     * fallen behind far enough to fill the FIFO, this sleeps until it
+     * catches up.
+     */
+    void write(const juce::AudioBuffer<float>& source, const int numSamples);
+
+private:
+
+    // Size of the output stream's buffer, which is the size of each write to disk.
+    static const size_t diskWriteSize = 1 << 20;
+
+    // How long write() sleeps between tries while the FIFO is full.
+    static constexpr int fullFifoSleepMillis = 1;
+
+    juce::TimeSliceThread writerThread;
+    std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> pThreadedWriter;
+
+    // write() queues at most this much at a time, through these per-channel pointers.
+    const int maxPieceSize;
+    juce::HeapBlock<const float*> pieceChannels;
+    int numWriterChannels = 0;
+};
+
+}
@@ -0,0 +1,322 @@
+
+#include "BlockCapture.h"
+
+#include "MemoryAccounting.h"
+
+using namespace juce;
+using namespace juce_igutil;
+
+namespace {
+
+// How often the writer thread looks for captured blocks.
+const int writerPollMillis = 10;
+
+// Samples of one channel of a captured block, in its own precision.
+template <typename SampleType>
+inline SampleType* channelInSlot(char* pSlotSamples, const int channel, const int maxBlockSize)
+{
+    return reinterpret_cast<SampleType*>(pSlotSamples) + (size_t) channel * (size_t) maxBlockSize;
+}
+
+}
+
+/**
+ * Construct.  Everything the audio thread will touch is allocated here.
+ */
+BlockCapture::BlockCapture(
+    std::shared_ptr<MTLogger> _pMTL,
+    const File& file,
+    const double sampleRate,
+    const int _maxBlockSize,
+    const int _maxChannels,
+    const int _numSlots,
+    const int _maxMidiEvents,
+    const int _maxMidiBytes
+) :
+    pMTL(_pMTL),
+    maxBlockSize(_maxBlockSize),
+    maxChannels(_maxChannels),
+    numSlots(_numSlots),
+    maxMidiEvents(_maxMidiEvents),
+    maxMidiBytes(_maxMidiBytes),
+    fileName(file.getFullPathName()),
+    startTime(std::chrono::steady_clock::now())
+{
+    slots.resize((size_t) numSlots);
+    slotSampleBytes = sizeof(double) * (size_t) maxChannels * (size_t) maxBlockSize;
+    samplePool.resize(slotSampleBytes * (size_t) numSlots);
+    midiEventPool.resize((size_t) (maxMidiEvents * numSlots));
+    midiBytePool.resize((size_t) (maxMidiBytes * numSlots));
+
+    file.deleteFile();
+    pStream = file.createOutputStream();
+    if ( !pStream || pStream->failedToOpen() ) {
+        pStream.reset();
+        pMTL->error(String("CAPTURE:  could not create capture file: ") + fileName);
+        return;
+    }
+
+    if ( !(pStream->writeInt(fileMagic) && pStream->writeInt(fileVersion) && pStream->writeDouble(sampleRate) &&
+        pStream->writeInt(maxBlockSize) && pStream->writeInt(maxChannels)) ) {
+        pStream.reset();
+        pMTL->error(String("CAPTURE:  could not write the capture file header: ") + fileName);
+        return;
+    }
+
+    pMTL->info(String("CAPTURE:  capturing blocks to ") + fileName);
+    writerThread = std::thread(&BlockCapture::writeLoop, this);
+}
+
+/**
+ * Destruct.  The writer thread drains the ring before it exits.
+ */
+BlockCapture::~BlockCapture()
+{
+    stopping.store(true);
+    if (writerThread.joinable())
+        writerThread.join();
+
+    if (pStream) {
+        pMTL->info(String("CAPTURE:  stopped, ") + String(numCaptured.load()) + String(" blocks captured, ") +
+            String(numDropped.load()) + String(" dropped, in ") + fileName);
+    }
+}
+
+/**
+ * Capture float input.
+ */
+void BlockCapture::beginBlock(const AudioBuffer<float>& buffer, const MidiBuffer& midiMessages)
+{
+    Slot* pSlot = claimSlot(buffer.getNumChannels(), buffer.getNumSamples(), false, midiMessages);
+    if ( !pSlot ) return;
+
+    char* pSlotSamples = samplePool.data() + slotSampleBytes * (size_t) (pSlot - slots.data());
+    for (int chan = 0; chan < pSlot->numChannels; ++chan)
+        FloatVectorOperations::copy(channelInSlot<float>(pSlotSamples, chan, maxBlockSize), buffer.getReadPointer(chan), pSlot->numSamples);
+}
+
+/**
+ * Capture double input.
+ */
+void BlockCapture::beginBlock(const AudioBuffer<double>& buffer, const MidiBuffer& midiMessages)
+{
+    Slot* pSlot = claimSlot(buffer.getNumChannels(), buffer.getNumSamples(), true, midiMessages);
+    if ( !pSlot ) return;
+
+    char* pSlotSamples = samplePool.data() + slotSampleBytes * (size_t) (pSlot - slots.data());
+    for (int chan = 0; chan < pSlot->numChannels; ++chan)
+        FloatVectorOperations::copy(channelInSlot<double>(pSlotSamples, chan, maxBlockSize), buffer.getReadPointer(chan), pSlot->numSamples);
+}
+
+/**
+ * Publish the pending slot, if the block was captured.
+ */
+void BlockCapture::endBlock(const long long processNanos)
+{
+    if ( !pPendingSlot ) return;
+
+    pPendingSlot->processNanos = processNanos;
+    pPendingSlot = nullptr;
+    writeIndex.store(writeIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * Find room for the block.  Blocks that don't fit - ring full, too long,
+ * or too much MIDI - are dropped, leaving a gap in the block indices, as
+ * is every block once a write has failed.
+ */
+BlockCapture::Slot* BlockCapture::claimSlot(
+    const int numChannels,
+    const int numSamples,
+    const bool isDouble,
+    const MidiBuffer& midiMessages)
+{
+    const juce::int64 blockIndex = nextBlockIndex++;
+    pPendingSlot = nullptr;
+
+    const juce::uint64 index = writeIndex.load(std::memory_order_relaxed);
+    if ( !pStream || writeFailed.load(std::memory_order_relaxed) ||
+        numSamples > maxBlockSize || midiMessages.getNumEvents() > maxMidiEvents ||
+        index - readIndex.load(std::memory_order_acquire) >= (juce::uint64) numSlots ) {
+        numDropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    const int slotIndex = (int) (index % (juce::uint64) numSlots);
+    MidiEvent* pEvents = midiEventPool.data() + slotIndex * maxMidiEvents;
+    juce::uint8* pBytes = midiBytePool.data() + slotIndex * maxMidiBytes;
+    int numEvents = 0;
+    int numBytes = 0;
+    for (const auto metadata : midiMessages) {
+        if (numBytes + metadata.numBytes > maxMidiBytes) {
+            numDropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        pEvents[numEvents++] = MidiEvent{ metadata.samplePosition, metadata.numBytes, numBytes };
+        std::memcpy(pBytes + numBytes, metadata.data, (size_t) metadata.numBytes);
+        numBytes += metadata.numBytes;
+    }
+
+    Slot& slot = slots[(size_t) slotIndex];
+    slot.blockIndex = blockIndex;
+    slot.startNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    slot.processNanos = 0;
+    slot.isDouble = isDouble ? 1 : 0;
+    slot.numChannels = jmin(numChannels, maxChannels);
+    slot.numSamples = numSamples;
+    slot.numMidiEvents = numEvents;
+
+    pPendingSlot = &slot;
+    return pPendingSlot;
+}
+
+/**
+ * Writer thread.  Drains everything published and flushes it, then
+ * sleeps.  One last drain after stopping catches the blocks published
+ * since.  Blocks only count as captured once they're flushed; after a
+ * failed write, the rest are drained without writing and count as dropped.
+ */
+void BlockCapture::writeLoop()
+{
+    AllocationCounter::setThreadName("block capture");
+    for (;;) {
+        const bool isLastPass = stopping.load();
+
+        juce::uint64 index = readIndex.load(std::memory_order_relaxed);
+        const juce::uint64 end = writeIndex.load(std::memory_order_acquire);
+        juce::uint64 numWritten = 0;
+        for (; index < end; ++index) {
+            if ( !writeFailed.load(std::memory_order_relaxed) ) {
+                if (writeSlot((int) (index % (juce::uint64) numSlots))) {
+                    ++numWritten;
+                }
+                else {
+                    stopOnWriteError(numWritten + 1);
+                    numWritten = 0;
+                }
+            }
+            else {
+                numDropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            readIndex.store(index + 1, std::memory_order_release);
+        }
+
+        if (numWritten > 0) {
+            pStream->flush();
+            if (pStream->getStatus().wasOk())
+                numCaptured.fetch_add(numWritten, std::memory_order_relaxed);
+            else
+                stopOnWriteError(numWritten);
+        }
+
+        if (isLastPass) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(writerPollMillis));
+    }
+}
+
+/**
+ * Write one block record.  Stops at the first write that fails.
+ */
+bool BlockCapture::writeSlot(const int slotIndex)
+{
+    const Slot& slot = slots[(size_t) slotIndex];
+    bool ok = pStream->writeInt64(slot.blockIndex) &&
+        pStream->writeInt64(slot.startNanos) &&
+        pStream->writeInt64(slot.processNanos) &&
+        pStream->writeInt(slot.isDouble) &&
+        pStream->writeInt(slot.numChannels) &&
+        pStream->writeInt(slot.numSamples) &&
+        pStream->writeInt(slot.numMidiEvents);
+
+    char* pSlotSamples = samplePool.data() + slotSampleBytes * (size_t) slotIndex;
+    const size_t sampleSize = slot.isDouble ? sizeof(double) : sizeof(float);
+    for (int chan = 0; ok && chan < slot.numChannels; ++chan)
+        ok = pStream->write(pSlotSamples + sampleSize * (size_t) chan * (size_t) maxBlockSize, sampleSize * (size_t) slot.numSamples);
+
+    const MidiEvent* pEvents = midiEventPool.data() + slotIndex * maxMidiEvents;
+    const juce::uint8* pBytes = midiBytePool.data() + slotIndex * maxMidiBytes;
+    for (int i = 0; ok && i < slot.numMidiEvents; ++i) {
+        ok = pStream->writeInt(pEvents[i].samplePosition) &&
+            pStream->writeInt(pEvents[i].numBytes) &&
+            pStream->write(pBytes + pEvents[i].byteOffset, (size_t) pEvents[i].numBytes);
+    }
+    return ok;
+}
+
+/**
+ * Stop capturing after a failed write.  The blocks written since the last
+ * flush may not have made it, so they count as dropped.
+ */
+void BlockCapture::stopOnWriteError(const juce::uint64 numUnflushed)
+{
+    writeFailed.store(true, std::memory_order_relaxed);
+    numDropped.fetch_add(numUnflushed, std::memory_order_relaxed);
+    pMTL->error(String("CAPTURE:  write failed (") + pStream->getStatus().getErrorMessage() +
+        String("); capture stopped, the file ends early: ") + fileName);
+}
+
+//==============================================================================
+/**
+ * Open a capture file and check its header.
+ */
+BlockCaptureReader::BlockCaptureReader(const File& file)
+{
+    pStream = file.createInputStream();
+    if ( !pStream || pStream->failedToOpen() ) {
+        pStream.reset();
+        return;
+    }
+
+    if (pStream->readInt() != BlockCapture::fileMagic || pStream->readInt() != BlockCapture::fileVersion) {
+        pStream.reset();
+        return;
+    }
+
+    sampleRate = pStream->readDouble();
+    maxBlockSize = pStream->readInt();
+    numChannels = pStream->readInt();
+}
+
+/**
+ * Read one block record.
+ */
+bool BlockCaptureReader::readNext(Block& block)
+{
+    if ( !pStream || pStream->isExhausted() ) return false;
+
+    block.blockIndex = pStream->readInt64();
+    block.startNanos = pStream->readInt64();
+    block.processNanos = pStream->readInt64();
+    block.isDouble = pStream->readInt() != 0;
+    const int blockChannels = pStream->readInt();
+    const int numSamples = pStream->readInt();
+    const int numMidiEvents = pStream->readInt();
+    if (blockChannels < 0 || blockChannels > numChannels || numSamples < 0 || numSamples > maxBlockSize || numMidiEvents < 0)
+        return false;
+
+    // Channels that weren't captured replay as silence.
+    block.floatBuffer.setSize(block.isDouble ? 0 : numChannels, numSamples);
+    block.doubleBuffer.setSize(block.isDouble ? numChannels : 0, numSamples);
+    block.floatBuffer.clear();
+    block.doubleBuffer.clear();
+    const size_t numBytes = (block.isDouble ? sizeof(double) : sizeof(float)) * (size_t) numSamples;
+    for (int chan = 0; chan < blockChannels; ++chan) {
+        void* pDest = block.isDouble ? (void*) block.doubleBuffer.getWritePointer(chan) : (void*) block.floatBuffer.getWritePointer(chan);
+        if (pStream->read(pDest, (int) numBytes) != (int) numBytes)
+            return false;
+    }
+
+    block.midiMessages.clear();
+    HeapBlock<juce::uint8> eventBytes;
+    for (int i = 0; i < numMidiEvents; ++i) {
+        const int samplePosition = pStream->readInt();
+        const int eventSize = pStream->readInt();
+        if (eventSize <= 0) return false;
+        eventBytes.allocate((size_t) eventSize, false);
+        if (pStream->read(eventBytes.get(), eventSize) != eventSize)
+            return false;
+        block.midiMessages.addEvent(eventBytes.get(), eventSize, samplePosition);
+    }
+
+    return true;
+}
@@ -0,0 +1,191 @@
+// Block Capture
+//
+// Records what processBlock() was given - every block's input samples, MIDI events,
+// size and timing - so a spike seen in a real session can be replayed offline (see
+// BlockReplayer).  The audio thread copies each block into a preallocated ring and
+// never locks or allocates; a background thread drains the ring to disk.  If the
+// disk can't keep up, blocks are dropped and counted rather than blocking the audio.
+//
+// File format (little-endian):  a header of magic, version, sample rate, max block
+// size and channel count, then one record per block:  block index, start time and
+// processing time in nanos, precision, channels, samples, MIDI event count, the
+// samples channel by channel in the captured precision, then each MIDI event as
+// sample position, byte count and bytes.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "MTLogger.h"
+
+namespace juce_igutil {
+
+class BlockCapture {
+
+public:
+
+    static const int fileMagic = 0x50414342;   // "BCAP"
+    static const int fileVersion = 1;
+
+    /**
+     * Construct.  Allocates the ring, creates (or replaces) the file and
+     * starts the writer thread.  Check isOpen() afterwards.  Not real-time
+     * safe; create it at prepare time.
+     *
+     * @param _pMTL - MT logger, for the summary when capture stops
+     * @param file - where to write
+     * @param sampleRate - recorded in the header for replay
+     * @param _maxBlockSize - larger blocks are dropped
+     * @param _maxChannels - channels beyond this aren't captured
+     * @param _numSlots - blocks the ring can hold before dropping
+     * @param _maxMidiEvents - per block; more are dropped
+     * @param _maxMidiBytes - per block; events that don't fit are dropped
+     */
+    BlockCapture(
+        std::shared_ptr<MTLogger> _pMTL,
+        const juce::File& file,
+        const double sampleRate,
+        const int _maxBlockSize,
+        const int _maxChannels,
+        const int _numSlots = 512,
+        const int _maxMidiEvents = 256,
+        const int _maxMidiBytes = 2048);
+
+    // Destruct.  Writes whatever is left in the ring, closes the file and logs a summary.
+    virtual ~BlockCapture();
+
+    inline bool isOpen() const { return pStream != nullptr; }
+
+    /**
+     * Copy a block's input and MIDI into the ring.  Call before processing
+     * the block, and endBlock() after.  Audio thread only.
+     */
+    void beginBlock(const juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages);
+    void beginBlock(const juce::AudioBuffer<double>& buffer, const juce::MidiBuffer& midiMessages);
+
+    // Record how long the block took and hand it to the writer thread.  Audio thread only.
+    void endBlock(const long long processNanos);
+
+    // Safe to call from any thread.  Blocks count as captured once they're flushed to the file.
+    inline juce::uint64 getNumCaptured() const { return numCaptured.load(std::memory_order_relaxed); }
+    inline juce::uint64 getNumDropped() const { return numDropped.load(std::memory_order_relaxed); }
+
+    // Memory held by the ring and its pools.
+    inline size_t getBytesHeld() const
+    {
+        return slots.size() * sizeof(Slot) + samplePool.size() + midiEventPool.size() * sizeof(MidiEvent) + midiBytePool.size();
+    }
+
+private:
+
+    // One captured block.  Samples and MIDI live in the slot's part of the pools.
+    struct Slot {
+        juce::int64 blockIndex = 0;
+        juce::int64 startNanos = 0;
+        juce::int64 processNanos = 0;
+        int isDouble = 0;
+        int numChannels = 0;
+        int numSamples = 0;
+        int numMidiEvents = 0;
+    };
+
+    struct MidiEvent {
+        int samplePosition;
+        int numBytes;
+        int byteOffset;
+    };
+
+    // Claim the next slot and fill in everything but the samples.  Returns nullptr if the ring is full.
+    Slot* claimSlot(const int numChannels, const int numSamples, const bool isDouble, const juce::MidiBuffer& midiMessages);
+
+    // Writer thread:  drains the ring every few milliseconds until stopped, or until a write fails.
+    void writeLoop();
+    bool writeSlot(const int slotIndex);
+    void stopOnWriteError(const juce::uint64 numUnflushed);
+
+    std::shared_ptr<MTLogger> pMTL;
+    const int maxBlockSize;
+    const int maxChannels;
+    const int numSlots;
+    const int maxMidiEvents;
+    const int maxMidiBytes;
+
+    std::unique_ptr<juce::FileOutputStream> pStream;
+    juce::String fileName;
+
+    // Preallocated pools, numSlots of each part.
+    std::vector<Slot> slots;
+    std::vector<char> samplePool;           // room for maxChannels * maxBlockSize doubles per slot
+    size_t slotSampleBytes = 0;
+    std::vector<MidiEvent> midiEventPool;
+    std::vector<juce::uint8> midiBytePool;
+
+    // Single producer (audio thread), single consumer (writer thread).  Both only ever increase.
+    std::atomic<juce::uint64> writeIndex{ 0 };
+    std::atomic<juce::uint64> readIndex{ 0 };
+
+    // Audio thread only.
+    Slot* pPendingSlot = nullptr;
+    juce::int64 nextBlockIndex = 0;
+    const std::chrono::steady_clock::time_point startTime;
+
+    std::atomic<juce::uint64> numCaptured{ 0 };
+    std::atomic<juce::uint64> numDropped{ 0 };
+
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> writeFailed{ false };     // set by the writer thread; the audio thread drops every block after
+    std::thread writerThread;
+
+    JUCE_DECLARE_NON_COPYABLE(BlockCapture)
+};
+
+/**
+ * Reads a capture file back, one block at a time.  Offline only:  it
+ * allocates freely.
+ */
+class BlockCaptureReader {
+
+public:
+
+    struct Block {
+        juce::int64 blockIndex = 0;
+        juce::int64 startNanos = 0;
+        juce::int64 processNanos = 0;
+        bool isDouble = false;
+
+        // Only the one matching isDouble holds the samples.
+        juce::AudioBuffer<float> floatBuffer;
+        juce::AudioBuffer<double> doubleBuffer;
+        juce::MidiBuffer midiMessages;
+
+        inline int getNumSamples() const { return isDouble ? doubleBuffer.getNumSamples() : floatBuffer.getNumSamples(); }
+    };
+
+    // Open and read the header.  Check isOpen() afterwards.
+    BlockCaptureReader(const juce::File& file);
+
+    virtual ~BlockCaptureReader() = default;
+
+    inline bool isOpen() const { return pStream != nullptr; }
+
+    inline double getSampleRate() const { return sampleRate; }
+    inline int getMaxBlockSize() const { return maxBlockSize; }
+    inline int getNumChannels() const { return numChannels; }
+
+    // Read the next block.  Returns false at the end of the file (or on a truncated record).
+    bool readNext(Block& block);
+
+private:
+
+    std::unique_ptr<juce::FileInputStream> pStream;
+    double sampleRate = 0.0;
+    int maxBlockSize = 0;
+    int numChannels = 0;
+};
+
+}
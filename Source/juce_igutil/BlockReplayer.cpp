@@ -0,0 +1,125 @@
+
+#include "BlockReplayer.h"
+
+#include "BlockCapture.h"
+#include "BufferConversion.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+using namespace juce;
+using namespace juce_igutil;
+
+/**
+ * Construct.
+ */
+BlockReplayer::BlockReplayer(std::shared_ptr<MTLogger> _pMTL) :
+    pMTL(_pMTL)
+{
+    // empty
+}
+
+/**
+ * Replay.
+ */
+bool BlockReplayer::replay(
+    AudioProcessor& processor,
+    const File& captureFile,
+    const Options& options)
+{
+    slowestBlocks.clear();
+
+    BlockCaptureReader reader(captureFile);
+    if ( !reader.isOpen() ) {
+        pMTL->error(String("REPLAY:  could not read capture file: ") + captureFile.getFullPathName());
+        return false;
+    }
+
+    const int maxBlockSize = reader.getMaxBlockSize();
+    const int numChannels = reader.getNumChannels();
+    pMTL->debug(String("REPLAY:  ") + captureFile.getFullPathName() + String(" at ") + String(reader.getSampleRate()) +
+        String(" Hz, up to ") + String(maxBlockSize) + String(" samples, ") + String(options.useDoublePrecision ? "double" : "single") +
+        String(" precision"));
+
+    // Left in real-time mode, so the processor behaves as it did when captured.
+    processor.setProcessingPrecision(options.useDoublePrecision ? AudioProcessor::doublePrecision : AudioProcessor::singlePrecision);
+    processor.setRateAndBufferSizeDetails(reader.getSampleRate(), maxBlockSize);
+    processor.prepareToPlay(reader.getSampleRate(), maxBlockSize);
+
+    // For converting blocks captured in the other precision.
+    AudioBuffer<float> floatBuffer(numChannels, maxBlockSize);
+    AudioBuffer<double> doubleBuffer(numChannels, maxBlockSize);
+
+    // Stats are logged once at the end, rather than by the profiler itself.
+    Profiler profiler("BlockReplayer", pMTL, 0, std::numeric_limits<unsigned long long>::max());
+    std::vector<BlockTiming> timings;
+
+    BlockCaptureReader::Block block;
+    juce::int64 expectedIndex = 0;
+    int numGaps = 0;
+    while (reader.readNext(block) && block.blockIndex <= options.lastBlock) {
+        // Dropped blocks never reached the file, so from here the state may differ.
+        if (block.blockIndex != expectedIndex) {
+            if (numGaps++ == 0)
+                pMTL->warning(String("REPLAY:  blocks missing from the capture before block ") + String(block.blockIndex) +
+                    String("; replay may not match from there."));
+        }
+        expectedIndex = block.blockIndex + 1;
+
+        const int numSamples = block.getNumSamples();
+        const bool isTimed = block.blockIndex >= options.firstBlock;
+        long long nanos = 0;
+        auto process = [&](auto& buffer) {
+            if (isTimed) {
+                profiler.start();
+                processor.processBlock(buffer, block.midiMessages);
+                nanos = profiler.stop();
+            }
+            else {
+                processor.processBlock(buffer, block.midiMessages);
+            }
+        };
+
+        if (options.useDoublePrecision) {
+            AudioBuffer<double> doubleBlock(doubleBuffer.getArrayOfWritePointers(), numChannels, numSamples);
+            if (block.isDouble) {
+                process(block.doubleBuffer);
+            }
+            else {
+                convertBuffer(doubleBlock, block.floatBuffer, numSamples);
+                process(doubleBlock);
+            }
+        }
+        else {
+            AudioBuffer<float> floatBlock(floatBuffer.getArrayOfWritePointers(), numChannels, numSamples);
+            if (block.isDouble) {
+                convertBuffer(floatBlock, block.doubleBuffer, numSamples);
+                process(floatBlock);
+            }
+            else {
+                process(block.floatBuffer);
+            }
+        }
+
+        if (isTimed)
+            timings.push_back(BlockTiming{ block.blockIndex, numSamples, nanos, block.processNanos });
+    }
+
+    processor.releaseResources();
+
+    // slowest first
+    const size_t numToReport = jmin(timings.size(), (size_t) jmax(0, options.numSlowestToReport));
+    std::partial_sort(timings.begin(), timings.begin() + (std::ptrdiff_t) numToReport, timings.end(),
+        [](const BlockTiming& a, const BlockTiming& b) { return a.replayNanos > b.replayNanos; });
+    slowestBlocks.assign(timings.begin(), timings.begin() + (std::ptrdiff_t) numToReport);
+
+    pMTL->info(String("REPLAY:  ") + String((int) timings.size()) + String(" blocks timed, ") + String(numGaps) +
+        String(" gaps.  ") + profiler.toString());
+    for (const auto& timing : slowestBlocks) {
+        pMTL->info(String("REPLAY:  block ") + String(timing.blockIndex) + String(" (") + String(timing.numSamples) +
+            String(" samples):  ") + String(timing.replayNanos) + String(" ns replayed, ") + String(timing.capturedNanos) +
+            String(" ns captured"));
+    }
+
+    return true;
+}
@@ -0,0 +1,78 @@
+// Block Replayer
+//
+// Feeds a BlockCapture file back through an AudioProcessor, block for block:  the
+// same sizes, input and MIDI, in either precision, with each block timed by a
+// Profiler.  Replay is deterministic, so a spike can be narrowed down by replaying
+// a smaller and smaller range of blocks around it.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <limits>
+#include <vector>
+
+#include "MTLogger.h"
+
+namespace juce_igutil {
+
+class BlockReplayer {
+
+public:
+
+    struct Options {
+        // use the AudioBuffer<double> processBlock() overload.  Captured blocks
+        // of the other precision are converted.
+        bool useDoublePrecision = false;
+
+        // Captured block indices to time and report, inclusive.  Blocks before the
+        // range are still processed, so the processor is in the same state it was
+        // in when the range was captured; blocks after it aren't processed at all.
+        juce::int64 firstBlock = 0;
+        juce::int64 lastBlock = std::numeric_limits<juce::int64>::max();
+
+        // How many of the slowest blocks to log.
+        int numSlowestToReport = 10;
+    };
+
+    // The timing of one replayed block.
+    struct BlockTiming {
+        juce::int64 blockIndex = 0;
+        int numSamples = 0;
+        juce::int64 replayNanos = 0;
+        juce::int64 capturedNanos = 0;
+    };
+
+    // Construct
+    BlockReplayer(std::shared_ptr<MTLogger> _pMTL);
+
+    // Destruct
+    virtual ~BlockReplayer() = default;
+
+    /**
+     * Replay.  Prepares the processor at the captured sample rate and
+     * block size, runs the blocks, logs the stats and the slowest blocks,
+     * and releases the processor's resources when done.
+     *
+     * @param processor - the processor to run:  a fresh one, so its state
+     *                  matches the start of the capture
+     * @param captureFile - written by a BlockCapture
+     * @param options
+     *
+     * @return true if the capture could be read.
+     */
+    bool replay(
+        juce::AudioProcessor& processor,
+        const juce::File& captureFile,
+        const Options& options);
+
+    // The slowest blocks of the last replay, slowest first.
+    inline const std::vector<BlockTiming>& getSlowestBlocks() const { return slowestBlocks; }
+
+private:
+
+    std::shared_ptr<MTLogger> pMTL;
+    std::vector<BlockTiming> slowestBlocks;
+};
+
+}
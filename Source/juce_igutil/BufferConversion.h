@@ -0,0 +1,38 @@
+// Buffer Conversion
+//
+// Copy samples between single- and double-precision buffers without going through
+// AudioBuffer::makeCopyOf(), which calls setSize() and may allocate (it always does
+// when the destination refers to external memory, like an AlignedArena).
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace juce_igutil {
+
+// Copy the first numSamples of every channel both buffers have.  Never allocates.
+inline void convertBuffer(juce::AudioBuffer<double>& dest, const juce::AudioBuffer<float>& source, const int numSamples)
+{
+    jassert(numSamples <= dest.getNumSamples() && numSamples <= source.getNumSamples());
+    const int numChannels = juce::jmin(dest.getNumChannels(), source.getNumChannels());
+    for (int chan = 0; chan < numChannels; ++chan) {
+        const float* pSource = source.getReadPointer(chan);
+        double* pDest = dest.getWritePointer(chan);
+        for (int i = 0; i < numSamples; ++i)
+            pDest[i] = static_cast<double>(pSource[i]);
+    }
+}
+
+inline void convertBuffer(juce::AudioBuffer<float>& dest, const juce::AudioBuffer<double>& source, const int numSamples)
+{
+    jassert(numSamples <= dest.getNumSamples() && numSamples <= source.getNumSamples());
+    const int numChannels = juce::jmin(dest.getNumChannels(), source.getNumChannels());
+    for (int chan = 0; chan < numChannels; ++chan) {
+        const double* pSource = source.getReadPointer(chan);
+        float* pDest = dest.getWritePointer(chan);
+        for (int i = 0; i < numSamples; ++i)
+            pDest[i] = static_cast<float>(pSource[i]);
+    }
+}
+
+}
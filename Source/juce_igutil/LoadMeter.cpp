@@ -0,0 +1,119 @@
+
+#include "LoadMeter.h"
+
+using namespace juce;
+using namespace juce_igutil;
+
+/**
+ * Construct.
+ */
+LoadMeter::LoadMeter(
+    std::shared_ptr<MTLogger> _pMTL,
+    const double _averagingSeconds,
+    const double _peakHoldSeconds
+):
+    pMTL(_pMTL),
+    averagingSeconds(_averagingSeconds),
+    peakHoldSeconds(_peakHoldSeconds)
+{
+    // empty
+}
+
+/**
+ * Prepare.
+ */
+void LoadMeter::prepare(const double _sampleRate)
+{
+    sampleRate = _sampleRate;
+    coefficientNumSamples = 0;
+    peakHoldRemaining = 0.0;
+    level = levelNormal;
+    averageLoad.store(0.0);
+    peakLoad.store(0.0);
+    lastLoad.store(0.0);
+    deadlineMisses.store(0);
+}
+
+/**
+ * Set thresholds.
+ */
+void LoadMeter::setThresholds(const double warning, const double overload)
+{
+    jassert(warning <= overload);
+    warningThreshold.store(warning);
+    overloadThreshold.store(overload);
+}
+
+/**
+ * Record one block.  Everything here is a handful of arithmetic ops except
+ * when the block size changes (two exp() calls) or a threshold is crossed
+ * (one log message).
+ */
+void LoadMeter::addBlock(const long long nanos, const int numSamples)
+{
+    if (sampleRate <= 0.0 || numSamples <= 0) return;
+
+    const double blockSeconds = numSamples / sampleRate;
+    if (numSamples != coefficientNumSamples) {
+        coefficientNumSamples = numSamples;
+        averageCoefficient = 1.0 - std::exp(-blockSeconds / averagingSeconds);
+        peakDecayCoefficient = std::exp(-blockSeconds / averagingSeconds);
+    }
+
+    const double load = nanos * 1.0e-9 / blockSeconds;
+    lastLoad.store(load, std::memory_order_relaxed);
+    if (load > 1.0) {
+        deadlineMisses.store(deadlineMisses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // moving average
+    const double average = averageLoad.load(std::memory_order_relaxed);
+    const double newAverage = average + averageCoefficient * (load - average);
+    averageLoad.store(newAverage, std::memory_order_relaxed);
+
+    // peak hold, then decay towards the current load
+    double peak = peakLoad.load(std::memory_order_relaxed);
+    if (load >= peak) {
+        peak = load;
+        peakHoldRemaining = peakHoldSeconds;
+    }
+    else if (peakHoldRemaining > 0.0) {
+        peakHoldRemaining -= blockSeconds;
+    }
+    else {
+        peak = jmax(load, peak * peakDecayCoefficient);
+    }
+    peakLoad.store(peak, std::memory_order_relaxed);
+
+    checkThresholds(newAverage);
+}
+
+/**
+ * Log when the average moves between normal, warning and overload.  Going
+ * down a level needs the load to drop below the threshold by the
+ * hysteresis factor, so a load sitting right at a threshold doesn't flood
+ * the log.
+ */
+void LoadMeter::checkThresholds(const double load)
+{
+    const double warning = warningThreshold.load(std::memory_order_relaxed);
+    const double overload = overloadThreshold.load(std::memory_order_relaxed);
+
+    Level newLevel = levelNormal;
+    if (load >= overload) newLevel = levelOverload;
+    else if (level == levelOverload && load >= overload * hysteresis) newLevel = levelOverload;
+    else if (load >= warning) newLevel = levelWarning;
+    else if (level != levelNormal && load >= warning * hysteresis) newLevel = levelWarning;
+
+    if (newLevel == level) return;
+
+    const String loadText = String(load * 100.0, 1) + String("%");
+    if (newLevel == levelOverload)
+        pMTL->error(String("LOAD:  overloaded, average DSP load ") + loadText + String(" >= ") + String(overload * 100.0, 1) + String("%"));
+    else if (newLevel == levelWarning && level == levelNormal)
+        pMTL->warning(String("LOAD:  high, average DSP load ") + loadText + String(" >= ") + String(warning * 100.0, 1) + String("%"));
+    else
+        pMTL->info(String("LOAD:  back down to ") + loadText + String(" (") + String(newLevel == levelNormal ? "normal" : "high") + String(")"));
+
+    level = newLevel;
+}
@@ -0,0 +1,94 @@
+// Load Meter
+//
+// Real-time DSP load, the way hosts show it:  time spent processing a block divided
+// by the block's real-time duration (numSamples / sampleRate).  Keeps an exponential
+// moving average and a peak hold, counts deadline misses, and logs when the average
+// crosses the warning or overload threshold.  Cheap enough to leave on always.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+#include "MTLogger.h"
+
+namespace juce_igutil {
+
+class LoadMeter {
+
+public:
+
+    /**
+     * Construct.
+     *
+     * @param _pMTL - MT logger, for threshold crossings
+     * @param _averagingSeconds - time constant of the moving average
+     * @param _peakHoldSeconds - how long a peak is held before it decays
+     */
+    LoadMeter(
+        std::shared_ptr<MTLogger> _pMTL,
+        const double _averagingSeconds = 0.5,
+        const double _peakHoldSeconds = 2.0);
+
+    // Destruct
+    virtual ~LoadMeter() = default;
+
+    // Set the sample rate and clear everything.  Not real-time safe.
+    void prepare(const double sampleRate);
+
+    /**
+     * Set the load levels (1.0 = 100%) that get logged when the average
+     * crosses them.  Safe to call from any thread.
+     */
+    void setThresholds(const double warning, const double overload);
+
+    /**
+     * Record one block.  Audio thread only.
+     *
+     * @param nanos - time spent processing the block, e.g. from
+     *              Profiler::stop()
+     * @param numSamples - number of samples in the block
+     */
+    void addBlock(const long long nanos, const int numSamples);
+
+    // These are safe to call from any thread.  1.0 = 100%.
+    inline double getLoad() const { return averageLoad.load(std::memory_order_relaxed); }
+    inline double getPeakLoad() const { return peakLoad.load(std::memory_order_relaxed); }
+    inline double getLastLoad() const { return lastLoad.load(std::memory_order_relaxed); }
+    inline juce::uint64 getDeadlineMisses() const { return deadlineMisses.load(std::memory_order_relaxed); }
+
+private:
+
+    // Crossing back below a threshold needs the load to fall this far under it.
+    static constexpr double hysteresis = 0.9;
+
+    enum Level { levelNormal = 0, levelWarning, levelOverload };
+
+    void checkThresholds(const double load);
+
+    std::shared_ptr<MTLogger> pMTL;
+
+    const double averagingSeconds;
+    const double peakHoldSeconds;
+
+    double sampleRate = 0.0;
+
+    // smoothing coefficients, recomputed only when the block size changes
+    int coefficientNumSamples = 0;
+    double averageCoefficient = 0.0;
+    double peakDecayCoefficient = 0.0;
+
+    double peakHoldRemaining = 0.0;
+    Level level = levelNormal;
+
+    std::atomic<double> warningThreshold { 0.7 };
+    std::atomic<double> overloadThreshold { 0.9 };
+
+    std::atomic<double> averageLoad { 0.0 };
+    std::atomic<double> peakLoad { 0.0 };
+    std::atomic<double> lastLoad { 0.0 };
+    std::atomic<juce::uint64> deadlineMisses { 0 };
+};
+
+}
@@ -1,5 +1,7 @@
 #include "MTLogger.h"
 
+#include "MemoryAccounting.h"
+
 using namespace juce;
 using namespace juce_igutil;
 
@@ -65,6 +67,14 @@ void MTLogger::error(const juce::String& message) {
     debug(message);
 }
 
+/**
+ * Queue depth.  A shared lock is enough to read the size.
+ */
+size_t MTLogger::getQueueDepth() {
+    std::shared_lock<std::shared_mutex> lock(queueMutex);
+    return queue.size();
+}
+
 /**
  * Loops forever, safely pulling from the queue and writing to 
  * the log.  Runs on its own thread, started from the 
@@ -72,6 +82,7 @@ void MTLogger::error(const juce::String& message) {
  */
 void MTLogger::logLoop(LogLoopArgs args)
 {
+    AllocationCounter::setThreadName("logger");
     bool done = false;
     while ( !done ) {
         
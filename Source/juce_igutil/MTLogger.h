@@ -27,6 +27,9 @@ public:
     void warning(const juce::String& message);
     void error(const juce::String& message);
 
+    // Messages waiting to be written.  Takes the queue lock, so not for the audio thread.
+    size_t getQueueDepth();
+
 private:
 
     // Logger.  Only use while the worker thread is not created nor joined.
@@ -0,0 +1,239 @@
+
+#include "MemoryAccounting.h"
+
+#include <cstdlib>
+#include <new>
+
+using namespace juce;
+using namespace juce_igutil;
+
+/**
+ * Add an item.
+ */
+void MemoryReport::add(const String& label, const size_t bytes, const Kind kind)
+{
+    items.push_back(Item{ label, bytes, kind });
+}
+
+/**
+ * Total, leaving out what's shared or already counted.
+ */
+size_t MemoryReport::getInstanceBytes() const
+{
+    size_t total = 0;
+    for (const auto& item : items)
+        if (item.kind == kindHeld) total += item.bytes;
+    return total;
+}
+
+/**
+ * Stringify.
+ */
+String MemoryReport::toString() const
+{
+    String text = String((juce::uint64) getInstanceBytes()) + String(" bytes held");
+    for (const auto& item : items) {
+        text += String(", ") + item.label + String(" ") + String((juce::uint64) item.bytes) +
+            String(item.kind == kindShared ? " (shared)" : item.kind == kindIncluded ? " (included above)" : "");
+    }
+    return text;
+}
+
+//==============================================================================
+thread_local AllocationCounter::Phase AllocationCounter::currentPhase = AllocationCounter::phaseIdle;
+thread_local AllocationCounter::ThreadSlot* AllocationCounter::pThreadSlot = nullptr;
+
+AllocationCounter::ThreadSlot AllocationCounter::threadSlots[AllocationCounter::maxThreads];
+std::atomic<int> AllocationCounter::numThreadSlots { 0 };
+std::atomic<juce::uint64> AllocationCounter::phaseAllocations[AllocationCounter::numPhases] = {};
+std::atomic<juce::uint64> AllocationCounter::phaseBytes[AllocationCounter::numPhases] = {};
+
+/**
+ * Enter a phase.
+ */
+AllocationCounter::ScopedPhase::ScopedPhase(const Phase phase) :
+    previous(currentPhase)
+{
+    currentPhase = phase;
+}
+
+/**
+ * Leave it.
+ */
+AllocationCounter::ScopedPhase::~ScopedPhase()
+{
+    currentPhase = previous;
+}
+
+/**
+ * Whether operator new counts.
+ */
+bool AllocationCounter::isEnabled()
+{
+   #ifdef COUNT_ALLOCATIONS
+    return true;
+   #else
+    return false;
+   #endif
+}
+
+/**
+ * Name the calling thread, unless it has a name already.
+ */
+void AllocationCounter::setThreadName(const char* name)
+{
+    const char* unnamed = nullptr;
+    getThreadSlot()->name.compare_exchange_strong(unnamed, name, std::memory_order_relaxed);
+}
+
+/**
+ * The calling thread's counts.
+ */
+AllocationCounter::Counts AllocationCounter::getThreadCounts()
+{
+    const ThreadSlot* pSlot = getThreadSlot();
+    return Counts{ pSlot->allocations.load(std::memory_order_relaxed), pSlot->bytes.load(std::memory_order_relaxed) };
+}
+
+/**
+ * One phase's counts, from every thread.
+ */
+AllocationCounter::Counts AllocationCounter::getPhaseCounts(const Phase phase)
+{
+    return Counts{ phaseAllocations[phase].load(std::memory_order_relaxed), phaseBytes[phase].load(std::memory_order_relaxed) };
+}
+
+/**
+ * Stringify.  Threads that haven't allocated since they were named still
+ * get a line.
+ */
+String AllocationCounter::toString()
+{
+    if ( !isEnabled() ) return String("allocation counting is off (define COUNT_ALLOCATIONS)");
+
+    String text;
+    for (int phase = 0; phase < numPhases; ++phase) {
+        const Counts counts = getPhaseCounts((Phase) phase);
+        text += String(phase == 0 ? "" : ", ") + String(getPhaseName((Phase) phase)) + String(" ") +
+            String(counts.allocations) + String(" (") + String(counts.bytes) + String(" bytes)");
+    }
+
+    const int numSlots = jmin(numThreadSlots.load(), (int) maxThreads);
+    for (int i = 0; i < numSlots; ++i) {
+        const ThreadSlot& slot = threadSlots[i];
+        const char* name = slot.name.load(std::memory_order_relaxed);
+        text += String(";  ") + (name != nullptr ? String(name) : String("thread ") + String(i)) + String(" ") +
+            String(slot.allocations.load(std::memory_order_relaxed)) + String(" (") +
+            String(slot.bytes.load(std::memory_order_relaxed)) + String(" bytes)");
+    }
+    return text;
+}
+
+/**
+ * Count one allocation.  A handful of relaxed atomic adds.
+ */
+void AllocationCounter::recordAllocation(const size_t bytes)
+{
+    ThreadSlot* pSlot = getThreadSlot();
+    pSlot->allocations.fetch_add(1, std::memory_order_relaxed);
+    pSlot->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    phaseAllocations[currentPhase].fetch_add(1, std::memory_order_relaxed);
+    phaseBytes[currentPhase].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * The calling thread's slot, claimed on first use.  Slots are never given
+ * back, so a process that keeps starting threads ends up sharing the last.
+ */
+AllocationCounter::ThreadSlot* AllocationCounter::getThreadSlot()
+{
+    if (pThreadSlot == nullptr)
+        pThreadSlot = &threadSlots[jmin(numThreadSlots.fetch_add(1), (int) maxThreads - 1)];
+    return pThreadSlot;
+}
+
+/**
+ * Phase names for the report.
+ */
+const char* AllocationCounter::getPhaseName(const Phase phase)
+{
+    switch (phase) {
+        case phaseConstruct:    return "construct";
+        case phasePrepare:      return "prepare";
+        case phaseProcess:      return "process";
+        case phaseProcessLogging: return "process (logging)";
+        case phaseRelease:      return "release";
+        default:                return "idle";
+    }
+}
+
+//==============================================================================
+#ifdef COUNT_ALLOCATIONS
+
+// The counting replacements for the global operator new and delete.  Counting is all
+// they add:  memory still comes from malloc().
+
+namespace {
+
+void* countedAlignedAlloc(const std::size_t size, const std::align_val_t alignment) noexcept
+{
+    AllocationCounter::recordAllocation(size);
+   #if JUCE_WINDOWS
+    return _aligned_malloc(size == 0 ? 1 : size, (size_t) alignment);
+   #else
+    void* p = nullptr;
+    return posix_memalign(&p, jmax((size_t) alignment, sizeof(void*)), size == 0 ? 1 : size) == 0 ? p : nullptr;
+   #endif
+}
+
+void alignedFree(void* p) noexcept
+{
+   #if JUCE_WINDOWS
+    _aligned_free(p);
+   #else
+    std::free(p);
+   #endif
+}
+
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    AllocationCounter::recordAllocation(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* p = operator new(size, std::nothrow)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void* p = countedAlignedAlloc(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return countedAlignedAlloc(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return countedAlignedAlloc(size, alignment); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(p); }
+
+#endif
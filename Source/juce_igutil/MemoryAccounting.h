@@ -0,0 +1,148 @@
+// Memory Accounting
+//
+// Two halves.  A MemoryReport lists what an instance holds - arena, buffers, synths,
+// capture ring, logger backlog - so servers can be sized from it.  The
+// AllocationCounter counts heap allocations per thread and per lifecycle phase
+// (construct, prepare, process, release, plus processBlock()'s own logging), so an
+// allocation creeping into processBlock() shows up as soon as it's made.
+//
+// Counting replaces the global operator new, so it's only compiled in with
+// COUNT_ALLOCATIONS defined project-wide.  Without it the counters read zero, and
+// the phase markers cost one thread-local store.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <vector>
+
+namespace juce_igutil {
+
+/**
+ * Bytes held, by item.  Built off the audio thread, when asked for; it
+ * allocates freely.
+ */
+class MemoryReport {
+
+public:
+
+    enum Kind {
+        kindHeld = 0,       // held by this instance
+        kindIncluded,       // part of an item above (e.g. buffers in the arena), listed for detail
+        kindShared          // held once for every instance in the process
+    };
+
+    struct Item {
+        juce::String label;
+        size_t bytes = 0;
+        Kind kind = kindHeld;
+    };
+
+    MemoryReport() = default;
+    virtual ~MemoryReport() = default;
+
+    /**
+     * Add an item.
+     *
+     * @param label - what holds the memory
+     * @param bytes - how much
+     * @param kind - only kindHeld counts towards the instance's total
+     */
+    void add(const juce::String& label, const size_t bytes, const Kind kind = kindHeld);
+
+    inline const std::vector<Item>& getItems() const { return items; }
+
+    // Bytes held by this instance alone:  the kindHeld items.
+    size_t getInstanceBytes() const;
+
+    // One line:  the instance total, then every item.
+    juce::String toString() const;
+
+private:
+
+    std::vector<Item> items;
+};
+
+/**
+ * Process-wide allocation counts.  Everything is static:  there is only one
+ * operator new.
+ */
+class AllocationCounter {
+
+public:
+
+    enum Phase {
+        phaseIdle = 0,      // anything outside the phases below
+        phaseConstruct,
+        phasePrepare,
+        phaseProcess,
+        phaseProcessLogging,    // processBlock()'s own log messages, after its counts are taken
+        phaseRelease,
+        numPhases
+    };
+
+    struct Counts {
+        juce::uint64 allocations = 0;
+        juce::uint64 bytes = 0;
+    };
+
+    // Threads beyond this many share the last slot.
+    static const int maxThreads = 32;
+
+    /**
+     * Mark the calling thread as being in a phase for the object's lifetime,
+     * restoring the previous phase after.  Real-time safe.
+     */
+    class ScopedPhase {
+    public:
+        ScopedPhase(const Phase phase);
+        ~ScopedPhase();
+    private:
+        const Phase previous;
+        JUCE_DECLARE_NON_COPYABLE(ScopedPhase)
+    };
+
+    // True when built with COUNT_ALLOCATIONS; otherwise nothing is counted.
+    static bool isEnabled();
+
+    /**
+     * Name the calling thread in reports.  The first name given sticks, so
+     * a thread that also runs processBlock() keeps its own.  Threads never
+     * named show up as "thread N".  The name must be a string literal (or
+     * otherwise outlive the process's use of it).  Real-time safe.
+     */
+    static void setThreadName(const char* name);
+
+    // Every allocation made so far, by the calling thread and in one phase, process-wide.  Real-time safe.
+    static Counts getThreadCounts();
+    static Counts getPhaseCounts(const Phase phase);
+
+    // Per phase and per thread, one line each.  Allocates.
+    static juce::String toString();
+
+    // Called by the counting operator new.  Never allocates.
+    static void recordAllocation(const size_t bytes);
+
+private:
+
+    struct ThreadSlot {
+        std::atomic<const char*> name { nullptr };
+        std::atomic<juce::uint64> allocations { 0 };
+        std::atomic<juce::uint64> bytes { 0 };
+    };
+
+    static ThreadSlot* getThreadSlot();
+    static const char* getPhaseName(const Phase phase);
+
+    // Plain data, so reading them never allocates.
+    static thread_local Phase currentPhase;
+    static thread_local ThreadSlot* pThreadSlot;
+
+    static ThreadSlot threadSlots[maxThreads];
+    static std::atomic<int> numThreadSlots;
+    static std::atomic<juce::uint64> phaseAllocations[numPhases];
+    static std::atomic<juce::uint64> phaseBytes[numPhases];
+};
+
+}
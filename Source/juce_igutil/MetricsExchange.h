@@ -0,0 +1,93 @@
+// Metrics Exchange
+//
+// Passes a snapshot of processor metrics from the audio thread to one reader (the
+// editor) through a triple buffer.  Publishing and reading are both wait-free:
+// the audio thread never locks, never allocates, and never sees the reader.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+namespace juce_igutil {
+
+// Everything the editor shows.  Plain data, so it can be copied freely.
+struct ProcessorMetrics {
+
+    enum Precision {
+        precisionUnknown = 0,
+        precisionSingle,
+        precisionDouble,
+        precisionSingleToDouble,    // single-precision host buffers, processed in double
+        precisionDoubleToSingle     // double-precision host buffers, processed in single
+    };
+
+    Precision precision = precisionUnknown;
+
+    // time spent in processBlock() as a percentage of the block's real-time duration:
+    // moving average and peak hold, from the LoadMeter
+    double cpuLoadPercent = 0.0;
+    double peakCpuLoadPercent = 0.0;
+
+    // 99th percentile processBlock() time
+    juce::int64 p99BlockNanos = 0;
+
+    // blocks that took longer than their real-time duration
+    juce::uint64 deadlineMisses = 0;
+
+    // from the SampleGuards
+    juce::uint64 denormals = 0;
+    juce::uint64 nonFinite = 0;
+};
+
+class MetricsExchange {
+
+public:
+
+    MetricsExchange() = default;
+    virtual ~MetricsExchange() = default;
+
+    // Audio thread only.  Copies the metrics in and swaps them to the middle slot.
+    void publish(const ProcessorMetrics& metrics)
+    {
+        slots[backIndex].metrics = metrics;
+        backIndex = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    /**
+     * Reader thread only (one reader).  Copies out the latest published
+     * metrics.
+     *
+     * @return true if they are new since the last read.
+     */
+    bool read(ProcessorMetrics& metrics)
+    {
+        const bool fresh = (middle.load(std::memory_order_relaxed) & freshBit) != 0;
+        if (fresh) {
+            frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & indexMask;
+        }
+        metrics = slots[frontIndex].metrics;
+        return fresh;
+    }
+
+private:
+
+    static const int indexMask = 3;
+    static const int freshBit = 4;
+
+    // each slot on its own cache line, so the two threads don't share any
+    struct alignas(64) Slot {
+        ProcessorMetrics metrics;
+    };
+    Slot slots[3];
+
+    // back is owned by the writer, front by the reader; middle is swapped between them
+    int backIndex = 0;
+    int frontIndex = 1;
+    std::atomic<int> middle { 2 };
+
+    JUCE_DECLARE_NON_COPYABLE(MetricsExchange)
+};
+
+}
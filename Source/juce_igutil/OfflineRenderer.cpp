@@ -0,0 +1,196 @@
+
+#include "OfflineRenderer.h"
+
+#include "AlignedArena.h"
+#include "AudioFileStream.h"
+#include "BufferConversion.h"
+
+#include "../audio_processing_double/SampleRateConverter.h"
+
+#include <type_traits>
+
+using namespace juce;
+using namespace juce_igutil;
+
+namespace {
+
+/**
+ * The render loop when the processor runs at a different rate from the
+ * files.  Reads blocks small enough that they never convert to more than
+ * blockSize samples, processes whatever comes out of the input converter,
+ * and keeps going past the end of the input (on silence) until the output
+ * converter has produced the whole length.
+ */
+template <typename ConverterType, typename SampleType>
+void renderResampled(
+    AudioProcessor& processor,
+    AudioFileStreamReader* pReader,
+    AudioFileStreamWriter& writer,
+    const double fileRate,
+    const double renderRate,
+    const int64 lengthInSamples,
+    const int numChannels,
+    const OfflineRenderer::Options& options)
+{
+    const int blockSize = options.blockSize;
+    const auto quality = static_cast<typename ConverterType::Quality>(options.resamplingQuality);
+
+    AlignedArena arena;
+    ConverterType converterIn(quality);
+    ConverterType converterOut(quality);
+    const int fileBlockSize = jmax(1, static_cast<int>((blockSize - 2) * fileRate / renderRate));
+    converterIn.prepare(fileRate, renderRate, numChannels, fileBlockSize, arena);
+    converterOut.prepare(renderRate, fileRate, numChannels, blockSize, arena);
+    const int maxOutputSamples = converterOut.getMaxOutputSamples(blockSize);
+    jassert(converterIn.getMaxOutputSamples(fileBlockSize) <= blockSize);
+
+    // the files are always read and written in float
+    const int fileBufferSize = jmax(fileBlockSize, maxOutputSamples);
+    AudioBuffer<float> fileBuffer(numChannels, fileBufferSize);
+    AudioBuffer<SampleType> workBuffer(numChannels, fileBufferSize);
+    AudioBuffer<SampleType> renderBuffer(numChannels, blockSize);
+    MidiBuffer midiMessages;
+
+    int64 numWritten = 0;
+    for (int64 position = 0; numWritten < lengthInSamples; position += fileBlockSize) {
+        const int numToRead = static_cast<int>(jlimit((int64)0, (int64)fileBlockSize, lengthInSamples - position));
+        fileBuffer.clear();
+        if (pReader && numToRead > 0) {
+            AudioBuffer<float> readBlock(fileBuffer.getArrayOfWritePointers(), numChannels, numToRead);
+            pReader->read(readBlock, numToRead);
+        }
+
+        // file rate to render rate
+        if constexpr (std::is_same<SampleType, float>::value) {
+            workBuffer.makeCopyOf(fileBuffer, true);
+        }
+        else {
+            juce_igutil::convertBuffer(workBuffer, fileBuffer, fileBlockSize);
+        }
+        const int numRender = converterIn.process(workBuffer, 0, fileBlockSize, renderBuffer, 0);
+
+        midiMessages.clear();
+        AudioBuffer<SampleType> renderBlock(renderBuffer.getArrayOfWritePointers(), numChannels, numRender);
+        processor.processBlock(renderBlock, midiMessages);
+
+        // and back
+        const int numOutput = converterOut.process(renderBlock, 0, numRender, workBuffer, 0);
+        const int numToWrite = static_cast<int>(jmin((int64)numOutput, lengthInSamples - numWritten));
+        if constexpr (std::is_same<SampleType, float>::value) {
+            fileBuffer.makeCopyOf(workBuffer, true);
+        }
+        else {
+            juce_igutil::convertBuffer(fileBuffer, workBuffer, numToWrite);
+        }
+        writer.write(fileBuffer, numToWrite);
+        numWritten += numToWrite;
+    }
+}
+
+}
+
+/**
+ * Construct.
+ */
+OfflineRenderer::OfflineRenderer(std::shared_ptr<MTLogger> _pMTL) :
+    pMTL(_pMTL)
+{
+    formatManager.registerBasicFormats();
+}
+
+/**
+ * Render.
+ */
+bool OfflineRenderer::render(
+    AudioProcessor& processor,
+    const File& inputFile,
+    const File& outputFile,
+    const Options& options)
+{
+    // open the input, if there is one
+    std::unique_ptr<AudioFileStreamReader> pReader;
+    double sampleRate = options.sampleRate;
+    int64 lengthInSamples = options.lengthInSamples;
+    if (inputFile != File()) {
+        pReader.reset(new AudioFileStreamReader(inputFile, formatManager, options.readChunkSize));
+        if ( !pReader->isOpen() ) {
+            pMTL->error(String("OFFLINE RENDER:  could not open input file: ") + inputFile.getFullPathName());
+            return false;
+        }
+        sampleRate = pReader->getSampleRate();
+        lengthInSamples = pReader->getLengthInSamples();
+    }
+
+    const int numChannels = processor.getTotalNumOutputChannels();
+    const int blockSize = options.blockSize;
+    const double renderRate = options.renderSampleRate > 0.0 ? options.renderSampleRate : sampleRate;
+
+    AudioFileStreamWriter writer(outputFile, formatManager, sampleRate, numChannels, options.outputBitsPerSample);
+    if ( !writer.isOpen() ) {
+        pMTL->error(String("OFFLINE RENDER:  could not create output file: ") + outputFile.getFullPathName());
+        return false;
+    }
+
+    pMTL->debug(String("OFFLINE RENDER:  rendering ") + String(lengthInSamples) + String(" samples, blockSize = ") +
+        String(blockSize) + String(pReader && pReader->isMemoryMapped() ? ", memory-mapped input" : "") +
+        (renderRate != sampleRate ? String(", processing at ") + String(renderRate) + String(" Hz") : String()));
+
+    // The processor may only build the processing path for the precision it's told about.
+    processor.setNonRealtime(true);
+    processor.setProcessingPrecision(options.useDoublePrecision ? AudioProcessor::doublePrecision : AudioProcessor::singlePrecision);
+
+    if (renderRate != sampleRate) {
+        processor.setRateAndBufferSizeDetails(renderRate, blockSize);
+        processor.prepareToPlay(renderRate, blockSize);
+
+        if (options.useDoublePrecision)
+            renderResampled<audio_processing_double::SampleRateConverter, double>(
+                processor, pReader.get(), writer, sampleRate, renderRate, lengthInSamples, numChannels, options);
+        else
+            renderResampled<audio_processing_float::SampleRateConverter, float>(
+                processor, pReader.get(), writer, sampleRate, renderRate, lengthInSamples, numChannels, options);
+
+        processor.releaseResources();
+        processor.setNonRealtime(false);
+
+        pMTL->debug(String("OFFLINE RENDER:  done, wrote ") + outputFile.getFullPathName());
+        return true;
+    }
+
+    // All buffers are allocated up front.  Only these are ever held in memory.
+    AudioBuffer<float> floatBuffer(numChannels, blockSize);
+    AudioBuffer<double> doubleBuffer(options.useDoublePrecision ? numChannels : 0, blockSize);
+    MidiBuffer midiMessages;
+
+    processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    for (int64 position = 0; position < lengthInSamples; position += blockSize) {
+        const int numSamples = static_cast<int>(jmin((int64)blockSize, lengthInSamples - position));
+
+        // Views of just this block, so the last, partial block has the right length.
+        AudioBuffer<float> floatBlock(floatBuffer.getArrayOfWritePointers(), numChannels, numSamples);
+
+        if (pReader) pReader->read(floatBlock, numSamples);
+        else floatBlock.clear();
+
+        midiMessages.clear();
+        if (options.useDoublePrecision) {
+            AudioBuffer<double> doubleBlock(doubleBuffer.getArrayOfWritePointers(), numChannels, numSamples);
+            convertBuffer(doubleBlock, floatBlock, numSamples);
+            processor.processBlock(doubleBlock, midiMessages);
+            convertBuffer(floatBlock, doubleBlock, numSamples);
+        }
+        else {
+            processor.processBlock(floatBlock, midiMessages);
+        }
+
+        writer.write(floatBlock, numSamples);
+    }
+
+    processor.releaseResources();
+    processor.setNonRealtime(false);
+
+    pMTL->debug(String("OFFLINE RENDER:  done, wrote ") + outputFile.getFullPathName());
+    return true;
+}
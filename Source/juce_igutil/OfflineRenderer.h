@@ -0,0 +1,74 @@
+// Offline Renderer
+//
+// Runs an AudioProcessor faster than real time, streaming its input from an audio
+// file and its output to another one, one block at a time.  Memory use is bounded
+// by the block and chunk sizes, not by the length of the files.  The processor can
+// run at a different sample rate from the files; the audio is converted in and out.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "MTLogger.h"
+
+#include "../audio_processing_float/SampleRateConverter.h"
+
+namespace juce_igutil {
+
+class OfflineRenderer {
+
+public:
+
+    struct Options {
+        // size of each processBlock() call
+        int blockSize = 512;
+
+        // use the AudioBuffer<double> processBlock() overload
+        bool useDoublePrecision = false;
+
+        // samples per channel in each prefetched input chunk
+        int readChunkSize = 65536;
+
+        int outputBitsPerSample = 24;
+
+        // Only used when there is no input file (e.g. for a synth).
+        double sampleRate = 44100.0;
+        juce::int64 lengthInSamples = 0;
+
+        // Run the processor at this rate (0 = the input file's rate), converting the
+        // input to it and the output back.  Conversion is done in the processing precision.
+        double renderSampleRate = 0.0;
+        audio_processing_float::SampleRateConverter::Quality resamplingQuality =
+            audio_processing_float::SampleRateConverter::qualityBest;
+    };
+
+    // Construct
+    OfflineRenderer(std::shared_ptr<MTLogger> _pMTL);
+
+    // Destruct
+    virtual ~OfflineRenderer() = default;
+
+    /**
+     * Render.  Prepares the processor, feeds it every block of the input,
+     * writes the output, and releases the processor's resources when done.
+     *
+     * @param processor - the processor to run
+     * @param inputFile - the file to stream in, or File() for none
+     * @param outputFile - the file to write.  Replaced if it exists.
+     * @param options
+     *
+     * @return true if everything was rendered.
+     */
+    bool render(
+        juce::AudioProcessor& processor,
+        const juce::File& inputFile,
+        const juce::File& outputFile,
+        const Options& options);
+
+private:
+
+    std::shared_ptr<MTLogger> pMTL;
+    juce::AudioFormatManager formatManager;
+};
+
+}
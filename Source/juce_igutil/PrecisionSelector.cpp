@@ -0,0 +1,86 @@
+
+#include "PrecisionSelector.h"
+
+using namespace juce;
+using namespace juce_igutil;
+
+/**
+ * Construct.
+ */
+PrecisionSelector::PrecisionSelector(
+    std::shared_ptr<MTLogger> _pMTL,
+    const double _holdSeconds,
+    const double _maxHoldSeconds
+):
+    pMTL(_pMTL),
+    holdSeconds(_holdSeconds),
+    maxHoldSeconds(_maxHoldSeconds)
+{
+    // empty
+}
+
+/**
+ * Prepare.
+ */
+void PrecisionSelector::prepare(const double _sampleRate, const bool startInDouble)
+{
+    sampleRate = _sampleRate;
+    currentHold = (juce::int64) (holdSeconds * sampleRate);
+    samplesSinceSwitch = 0;
+    lastSwitchWasUpgrade = false;
+    useDouble.store(startInDouble);
+    numSwitches.store(0);
+}
+
+/**
+ * Set thresholds.
+ */
+void PrecisionSelector::setThresholds(const double downgradeLoad, const double upgradeLoad)
+{
+    jassert(upgradeLoad < downgradeLoad);
+    downgradeThreshold.store(downgradeLoad);
+    upgradeThreshold.store(upgradeLoad);
+}
+
+/**
+ * Decide.  A handful of comparisons, plus one log message on a switch.
+ */
+bool PrecisionSelector::update(const double load, const int numSamples)
+{
+    samplesSinceSwitch += numSamples;
+    const bool isDoubleNow = useDouble.load(std::memory_order_relaxed);
+    if (samplesSinceSwitch < currentHold) return isDoubleNow;
+
+    if (isDoubleNow && load > downgradeThreshold.load(std::memory_order_relaxed)) {
+        switchTo(false, load);
+    }
+    else if ( !isDoubleNow && load < upgradeThreshold.load(std::memory_order_relaxed) ) {
+        switchTo(true, load);
+    }
+    return useDouble.load(std::memory_order_relaxed);
+}
+
+/**
+ * Switch, and back the hold off if this undoes an upgrade within twice its
+ * hold.  The hold only goes back to its base once the switch before this one
+ * has lasted that long, whichever way it went, so an upgrade after a backoff
+ * keeps the longer hold.
+ */
+void PrecisionSelector::switchTo(const bool toDouble, const double load)
+{
+    if (samplesSinceSwitch >= 2 * currentHold) {
+        currentHold = (juce::int64) (holdSeconds * sampleRate);
+    }
+    else if ( !toDouble && lastSwitchWasUpgrade ) {
+        currentHold = jmin(2 * currentHold, (juce::int64) (maxHoldSeconds * sampleRate));
+    }
+
+    lastSwitchWasUpgrade = toDouble;
+    samplesSinceSwitch = 0;
+    useDouble.store(toDouble, std::memory_order_relaxed);
+    numSwitches.fetch_add(1, std::memory_order_relaxed);
+
+    pMTL->info(String("PRECISION:  switching to ") + String(toDouble ? "double" : "single") +
+        String(" at ") + String(100.0 * load, 1) + String("% load; next switch in no less than ") +
+        String((double) currentHold / sampleRate, 1) + String(" s"));
+}
@@ -0,0 +1,88 @@
+// Precision Selector
+//
+// Decides, block by block, whether to render in double or single precision from the
+// measured DSP load:  drop to single when the average load climbs past a limit, and
+// go back to double once it has fallen well below it.  The gap between the two limits
+// plus a minimum hold time after every switch keep it from flapping, and the hold
+// doubles whenever an upgrade is undone straight away.  Switches are logged.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+#include "MTLogger.h"
+
+namespace juce_igutil {
+
+class PrecisionSelector {
+
+public:
+
+    /**
+     * Construct.
+     *
+     * @param _pMTL - MT logger, for switches
+     * @param _holdSeconds - least time between switches; the average load
+     *                     needs about this long to reflect a switch
+     * @param _maxHoldSeconds - the hold never backs off past this
+     */
+    PrecisionSelector(
+        std::shared_ptr<MTLogger> _pMTL,
+        const double _holdSeconds = 1.0,
+        const double _maxHoldSeconds = 30.0);
+
+    // Destruct
+    virtual ~PrecisionSelector() = default;
+
+    // Set the sample rate and starting precision, and clear the hold.  Not real-time safe.
+    void prepare(const double _sampleRate, const bool startInDouble);
+
+    /**
+     * Set the load levels (1.0 = 100%):  above downgradeLoad, drop to
+     * single; below upgradeLoad, go back to double.  upgradeLoad should
+     * leave room for what double costs over single.  Safe to call from
+     * any thread.
+     */
+    void setThresholds(const double downgradeLoad, const double upgradeLoad);
+
+    /**
+     * Record one block and decide the precision for the next.  Audio thread
+     * only.
+     *
+     * @param load - average load, e.g. from LoadMeter::getLoad()
+     * @param numSamples - number of samples in the block
+     *
+     * @return true if the next block should render in double.
+     */
+    bool update(const double load, const int numSamples);
+
+    // These are safe to call from any thread.
+    inline bool isDouble() const { return useDouble.load(std::memory_order_relaxed); }
+    inline juce::uint64 getNumSwitches() const { return numSwitches.load(std::memory_order_relaxed); }
+
+private:
+
+    void switchTo(const bool toDouble, const double load);
+
+    std::shared_ptr<MTLogger> pMTL;
+
+    const double holdSeconds;
+    const double maxHoldSeconds;
+
+    double sampleRate = 0.0;
+
+    // Audio thread only.  Times in samples.
+    juce::int64 samplesSinceSwitch = 0;
+    juce::int64 currentHold = 0;
+    bool lastSwitchWasUpgrade = false;
+
+    std::atomic<double> downgradeThreshold { 0.6 };
+    std::atomic<double> upgradeThreshold { 0.3 };
+
+    std::atomic<bool> useDouble { true };
+    std::atomic<juce::uint64> numSwitches { 0 };
+};
+
+}
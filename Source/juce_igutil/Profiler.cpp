@@ -51,19 +51,21 @@ const juce::String Profiler::toString() const {
  * Log start time
  */
 void Profiler::start() {
-    if (countOfWarmups >= maxWarmups) {
-        sw.start();
-    }
+    sw.start();
 }
 
 /**
  * Get elapsed time, store stats, and maybe output to the log
- * based on the modulo.
+ * based on the modulo.  The time is always measured (callers that compute
+ * CPU load need it during warmup too); only the stats wait for the
+ * warmup to finish.
  */
-void Profiler::stop() {
+long long Profiler::stop() {
+    //const std::chrono::duration<__int64, std::nano> nanos
+    const long long nanos = sw.stop().count();
+
     if (countOfWarmups >= maxWarmups) {
-        //const std::chrono::duration<__int64, std::nano> nanos
-        const long long nanos = sw.stop().count();
+        ++histogram[histogramIndex(nanos)];
 
         if (minNanos < 0 || nanos < minNanos) minNanos = nanos;
         if (nanos > maxNanos) maxNanos = nanos;
@@ -78,6 +80,52 @@ void Profiler::stop() {
     else {
         ++countOfWarmups;
     }
+
+    return nanos;
+}
+
+/**
+ * Histogram bucket for a time.  Below 16 nanos each value has its own
+ * bucket; above that, each power of two is split into 16 buckets.
+ */
+int Profiler::histogramIndex(const long long nanos) {
+    if (nanos < histogramSubBuckets) return nanos < 0 ? 0 : static_cast<int>(nanos);
+
+    int exponent = 4;
+    while ((nanos >> (exponent + 1)) != 0) ++exponent;
+
+    const int subBucket = static_cast<int>(nanos >> (exponent - 4)) - histogramSubBuckets;
+    const int index = (exponent - 3) * histogramSubBuckets + subBucket;
+    return index < histogramNumBuckets ? index : histogramNumBuckets - 1;
+}
+
+/**
+ * Smallest time that lands in the given bucket.
+ */
+long long Profiler::histogramLowerBound(const int index) {
+    if (index < histogramSubBuckets) return index;
+
+    const int exponent = index / histogramSubBuckets + 3;
+    const long long subBucket = index % histogramSubBuckets;
+    return (histogramSubBuckets + subBucket) << (exponent - 4);
+}
+
+/**
+ * Walk the histogram until the requested fraction of samples is covered.
+ * Reports the top of the bucket, so the result errs on the slow side.
+ */
+long long Profiler::getPercentileNanos(const double fraction) const {
+    if (totalSamples == 0) return 0;
+
+    const unsigned long long target = static_cast<unsigned long long>(std::ceil(fraction * totalSamples));
+    unsigned long long count = 0;
+    for (int i = 0; i < histogramNumBuckets; ++i) {
+        count += histogram[i];
+        if (count >= target) {
+            return i + 1 < histogramNumBuckets ? histogramLowerBound(i + 1) : maxNanos;
+        }
+    }
+    return maxNanos;
 }
 
 
@@ -44,11 +44,16 @@ public:
     // log start time
     void start();
 
-    // get elapsed time, store stats, and maybe output to the log based on the modulo
-    void stop();
+    // get elapsed time, store stats, and maybe output to the log based on the modulo.
+    // Returns the elapsed nanos, which are measured even during warmup.
+    long long stop();
 
     inline unsigned long long getTotalSamples() const { return totalSamples; }
 
+    // Approximate (within ~6%) percentile of the collected times, e.g. 0.99 for p99.
+    // Walks the whole histogram, so don't call it every block.
+    long long getPercentileNanos(const double fraction) const;
+
 private: 
 
     Stopwatch sw;
@@ -66,6 +71,14 @@ private:
     unsigned long long countOfWarmups;
     const unsigned long long outputModulo;
 
+    // Log-linear histogram of times for the percentiles:  16 buckets per power of
+    // two, up to 2^40 nanos (~18 minutes).  Fixed size, so stop() never allocates.
+    static const int histogramSubBuckets = 16;
+    static const int histogramNumBuckets = (40 - 3) * histogramSubBuckets;
+    static int histogramIndex(const long long nanos);
+    static long long histogramLowerBound(const int index);
+    unsigned int histogram[histogramNumBuckets] = {};
+
 };
 
 }
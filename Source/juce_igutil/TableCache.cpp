@@ -0,0 +1,199 @@
+
+#include "TableCache.h"
+
+#include "MemoryAccounting.h"
+
+#include <vector>
+
+using namespace juce_igutil;
+
+/**
+ * Construct an empty table.  Its memory is allocated when it's built.
+ */
+TableCache::Table::Table(const size_t _size, const bool _isDoublePrecision) :
+    size(_size),
+    doublePrecision(_isDoublePrecision),
+    arena(_size * (_isDoublePrecision ? sizeof(double) : sizeof(float)), false)
+{
+    // empty
+}
+
+/**
+ * Block until built.
+ */
+void TableCache::Table::waitUntilReady() const
+{
+    if (isReady())
+        return;
+
+    std::unique_lock<std::mutex> lock(readyMutex);
+    readyCondition.wait(lock, [this]() { return isReady(); });
+}
+
+/**
+ * Get the float values.
+ */
+void TableCache::Table::getData(const float*& pDest) const
+{
+    jassert(isReady() && !doublePrecision);
+    pDest = pFloatData;
+}
+
+/**
+ * Get the double values.
+ */
+void TableCache::Table::getData(const double*& pDest) const
+{
+    jassert(isReady() && doublePrecision);
+    pDest = pDoubleData;
+}
+
+/**
+ * Fill in the values and wake anyone waiting.  Float tables are designed
+ * in double and rounded once at the end.
+ */
+void TableCache::Table::build(const Builder& builder)
+{
+    if (doublePrecision) {
+        arena.allocate(pDoubleData, size);
+        builder(pDoubleData, size);
+    }
+    else {
+        std::vector<double> values(size);
+        builder(values.data(), size);
+        arena.allocate(pFloatData, size);
+        for (size_t i = 0; i < size; ++i)
+            pFloatData[i] = static_cast<float>(values[i]);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(readyMutex);
+        ready.store(true, std::memory_order_release);
+    }
+    readyCondition.notify_all();
+}
+
+/**
+ * Get the cache.  Created on first use.
+ */
+TableCache& TableCache::getInstance()
+{
+    static TableCache instance;
+    return instance;
+}
+
+/**
+ * Destruct.  The build thread exits as soon as its queue is empty, so by
+ * the time statics are destroyed it has normally finished already.
+ */
+TableCache::~TableCache()
+{
+    if (buildThread.joinable())
+        buildThread.join();
+}
+
+/**
+ * Find or queue a table.
+ */
+std::shared_ptr<const TableCache::Table> TableCache::acquire(
+    const juce::String& type,
+    const size_t size,
+    const bool isDoublePrecision,
+    Builder builder)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const Key key{ type, size, isDoublePrecision };
+    auto found = tables.find(key);
+    if (found != tables.end()) {
+        if (auto pTable = found->second.lock())
+            return pTable;
+    }
+
+    pruneExpired();
+    auto pTable = std::make_shared<Table>(size, isDoublePrecision);
+    tables[key] = pTable;
+    jobs.push_back(Job{ pTable, std::move(builder) });
+
+    // Start the build thread if it's not already working through the queue.
+    if ( !buildThreadRunning ) {
+        if (buildThread.joinable())
+            buildThread.join();
+        buildThreadRunning = true;
+        buildThread = std::thread(&TableCache::buildLoop, this);
+    }
+
+    return pTable;
+}
+
+/**
+ * Count live tables.
+ */
+int TableCache::getNumTables()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pruneExpired();
+    return static_cast<int>(tables.size());
+}
+
+/**
+ * Sum the sizes of live tables.
+ */
+size_t TableCache::getBytesHeld()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = 0;
+    for (auto& entry : tables) {
+        if (auto pTable = entry.second.lock())
+            bytes += pTable->getSize() * (pTable->isDoublePrecision() ? sizeof(double) : sizeof(float));
+    }
+    return bytes;
+}
+
+/**
+ * Build queued tables, one at a time, outside the lock.
+ */
+void TableCache::buildLoop()
+{
+    AllocationCounter::setThreadName("table cache");
+    for (;;) {
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (jobs.empty()) {
+                buildThreadRunning = false;
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job.pTable->build(job.builder);
+        ++numBuilds;
+    }
+}
+
+/**
+ * Forget freed tables.
+ */
+void TableCache::pruneExpired()
+{
+    for (auto it = tables.begin(); it != tables.end();) {
+        if (it->second.expired())
+            it = tables.erase(it);
+        else
+            ++it;
+    }
+}
+
+/**
+ * Order keys by type, then size, then precision.
+ */
+bool TableCache::Key::operator<(const Key& other) const
+{
+    if (type != other.type)
+        return type < other.type;
+    if (size != other.size)
+        return size < other.size;
+    return isDoublePrecision < other.isDoublePrecision;
+}
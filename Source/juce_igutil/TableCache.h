@@ -0,0 +1,143 @@
+// Shared Table Cache
+//
+// Read-only lookup tables (window functions, filter kernels, FFT twiddles...) shared
+// by every processor in the process.  A table is identified by its type, size and
+// precision.  The first processor to ask for one has it built on the cache's
+// background thread; later ones get the same memory.  Tables are reference counted
+// and freed when the last user lets go, so a second instance of the plugin costs
+// neither the memory nor the time to build them again.
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "AlignedArena.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace juce_igutil {
+
+class TableCache {
+
+public:
+
+    /**
+     * Fills in a table's values.  Always designed in double; float tables
+     * are rounded afterwards.  Called on the cache's thread, so it must not
+     * ask the cache for another table, and must capture what it needs by
+     * value.
+     */
+    using Builder = std::function<void(double* pDest, const size_t numValues)>;
+
+    // One immutable table.  Hold on to the shared_ptr for as long as the data is used.
+    class Table {
+
+    public:
+
+        Table(const size_t _size, const bool _isDoublePrecision);
+
+        // Block until the table is built.  Not real-time safe; call at prepare time.
+        void waitUntilReady() const;
+
+        inline bool isReady() const { return ready.load(std::memory_order_acquire); }
+        inline size_t getSize() const { return size; }
+        inline bool isDoublePrecision() const { return doublePrecision; }
+
+        // The values.  Overloaded so SAMPLE_TYPE code picks the right one; it has
+        // to match the precision the table was asked for.
+        void getData(const float*& pDest) const;
+        void getData(const double*& pDest) const;
+
+    private:
+        friend class TableCache;
+
+        void build(const Builder& builder);
+
+        const size_t size;
+        const bool doublePrecision;
+
+        AlignedArena arena;
+        float* pFloatData = nullptr;
+        double* pDoubleData = nullptr;
+
+        std::atomic<bool> ready{ false };
+        mutable std::mutex readyMutex;
+        mutable std::condition_variable readyCondition;
+
+        JUCE_DECLARE_NON_COPYABLE(Table)
+    };
+
+    // The one cache for the whole process.
+    static TableCache& getInstance();
+
+    // Destruct.  Waits for the background thread to finish what it's building.
+    virtual ~TableCache();
+
+    /**
+     * Get a table, shared with everyone else who asked for the same one.
+     * Returns immediately; if the table is new it is queued for the
+     * background thread, so call Table::waitUntilReady() before reading it.
+     * Asking for several tables before waiting on any lets them build while
+     * the caller gets on with the rest of its preparation.
+     *
+     * @param type - what the table is, including any design parameters
+     *             that aren't implied by its size
+     * @param size - number of values
+     * @param isDoublePrecision - double or float values
+     * @param builder - fills in the values, if the table has to be built
+     */
+    std::shared_ptr<const Table> acquire(
+        const juce::String& type,
+        const size_t size,
+        const bool isDoublePrecision,
+        Builder builder);
+
+    // Tables currently held by someone.
+    int getNumTables();
+
+    // Bytes held by those tables.
+    size_t getBytesHeld();
+
+    // Tables built since the process started.  Stays flat as instances are added.
+    inline int getNumBuilds() const { return numBuilds.load(); }
+
+private:
+
+    TableCache() = default;
+
+    struct Key {
+        juce::String type;
+        size_t size;
+        bool isDoublePrecision;
+
+        bool operator<(const Key& other) const;
+    };
+
+    struct Job {
+        std::shared_ptr<Table> pTable;
+        Builder builder;
+    };
+
+    // Background thread:  builds queued tables and exits when there are none left.
+    void buildLoop();
+
+    // Drop entries whose tables have been freed.  Call with mutex held.
+    void pruneExpired();
+
+    std::mutex mutex;
+    std::map<Key, std::weak_ptr<Table>> tables;
+    std::deque<Job> jobs;
+    std::thread buildThread;
+    bool buildThreadRunning = false;
+
+    std::atomic<int> numBuilds{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(TableCache)
+};
+
+}